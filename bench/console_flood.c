@@ -0,0 +1,118 @@
+/* Console throughput under a flood of log lines on a 1920x1080 screen with
+   the 16x32 font.
+
+     kprintf    kprintf() of each line, which flushes at most every
+                CONSOLE_FLUSH_TICKS
+     flush_all  console_write() and console_flush() of each line: a full
+                repaint and screen copy per line, the worst case
+     batched    console_write() of each line, one flush per 100 lines
+     klog       klog() of each line, the cost to the caller; drained every
+                KLOG_RING_RECORDS lines
+     klog_drain the deferred half: formatting and printing those records
+     memmove    for reference: scrolling the pixels instead, one memmove
+                of the screen up a text row per line, nothing drawn
+
+   usage: console_flood [lines] */
+
+#include "host.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <kernel/console/console.h>
+#include <kernel/fb/fb.h>
+#include <kernel/klog/klog.h>
+#include <kernel/stdio/kstdio.h>
+
+#define WIDTH 1920
+#define HEIGHT 1080
+
+static uint32_t screen[WIDTH * HEIGHT];
+
+static void report(const char *mode, unsigned long lines, uint64_t ns)
+{
+  printf("console_flood mode=%s lines=%lu ns=%llu lines_per_s=%.0f ns_per_line=%.1f\n", mode, lines,
+         (unsigned long long)ns, lines / (ns / 1e9), (double)ns / lines);
+}
+
+int main(int argc, char **argv)
+{
+  unsigned long lines = 20000;
+  if (argc > 1)
+    lines = strtoul(argv[1], NULL, 0);
+
+  host_boot(256ul << 20);
+
+  static struct limine_framebuffer fb;
+  fb.address = screen;
+  fb.width = WIDTH;
+  fb.height = HEIGHT;
+  fb.pitch = WIDTH * 4;
+  fb.bpp = 32;
+  if (!fb_init(&fb) || !console_init())
+  {
+    fprintf(stderr, "console_flood: no console\n");
+    return 1;
+  }
+
+  uint64_t t0 = host_ns();
+  for (unsigned long i = 0; i < lines; i++)
+    kprintf("pmm: node %u zone %u order %u free %lu pages, line %lu\n", (unsigned int)(i & 3), 2u,
+            (unsigned int)(i % 11), 1000 + i * 7, i);
+  console_flush();
+  report("kprintf", lines, host_ns() - t0);
+
+  char line[128];
+  t0 = host_ns();
+  for (unsigned long i = 0; i < lines / 20; i++)
+  {
+    int n = snprintf(line, sizeof(line), "slab: cache kmalloc-%u grew to %lu slabs, line %lu\n",
+                     16u << (i % 8), 10 + i, i);
+    console_write(line, n);
+    console_flush();
+  }
+  report("flush_all", lines / 20, host_ns() - t0);
+
+  t0 = host_ns();
+  for (unsigned long i = 0; i < lines; i++)
+  {
+    int n = snprintf(line, sizeof(line), "liballoc: exp %u complete %u tag at %p, line %lu\n",
+                     (unsigned int)(i % 24), (unsigned int)(i % 5), (void *)(uintptr_t)(i * 64), i);
+    console_write(line, n);
+    if (i % 100 == 99)
+      console_flush();
+  }
+  console_flush();
+  report("batched", lines, host_ns() - t0);
+
+  uint64_t record_ns = 0, drain_ns = 0;
+  for (unsigned long i = 0; i < lines; i++)
+  {
+    t0 = host_ns();
+    klog("pmm: node %u zone %u order %u free %lu pages, line %lu\n", (unsigned int)(i & 3), 2u,
+         (unsigned int)(i % 11), 1000 + i * 7, i);
+    record_ns += host_ns() - t0;
+    if (i % KLOG_RING_RECORDS == KLOG_RING_RECORDS - 1 || i == lines - 1)
+    {
+      t0 = host_ns();
+      klog_drain(KLOG_RING_RECORDS);
+      console_flush();
+      drain_ns += host_ns() - t0;
+    }
+  }
+  report("klog", lines, record_ns);
+  report("klog_drain", lines, drain_ns);
+  if (klog_dropped())
+  {
+    fprintf(stderr, "console_flood: klog dropped records\n");
+    return 1;
+  }
+
+  unsigned int row_pixels = 32 * WIDTH;
+  t0 = host_ns();
+  for (unsigned long i = 0; i < lines; i++)
+    memmove(screen, screen + row_pixels, (sizeof(screen) / 4 - row_pixels) * 4);
+  report("memmove", lines, host_ns() - t0);
+  return 0;
+}
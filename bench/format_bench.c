@@ -0,0 +1,48 @@
+/* Formatting throughput of the kernel's ksnprintf() against the host C
+   library's snprintf() on typical log lines. One line per format and
+   implementation.
+
+   usage: format_bench [calls] */
+
+#include "host.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <kernel/stdio/kstdio.h>
+
+static char line[KPRINTF_MAX];
+static volatile int sink;
+
+static void report(const char *name, const char *impl, unsigned long calls, uint64_t ns)
+{
+  printf("format_bench fmt=%s impl=%s calls=%lu ns=%llu ns_per_call=%.1f\n", name, impl, calls,
+         (unsigned long long)ns, (double)ns / calls);
+}
+
+#define RUN(name, fn, ...)                          \
+  do                                                \
+  {                                                 \
+    uint64_t t0 = host_ns();                        \
+    for (unsigned long i = 0; i < calls; i++)       \
+      sink += fn(line, sizeof(line), __VA_ARGS__);  \
+    report(name, #fn, calls, host_ns() - t0);       \
+  } while (0)
+
+int main(int argc, char **argv)
+{
+  unsigned long calls = 2000000;
+  if (argc > 1)
+    calls = strtoul(argv[1], NULL, 0);
+
+#define PMM_LINE "pmm: node %u zone %u order %u free %lu pages, line %lu\n", 3u, 2u, 9u, 1234567ul, calls
+#define PTR_LINE "liballoc: tag at %p size %zu exp %d\n", (void *)0xffff8000001234f0ul, (size_t)4096, 12
+#define HEX_LINE "pte %016lx flags %#x cr3 %#lx\n", 0x80000000fee0001bul, 0x63u, 0x1000ul
+  RUN("pmm", ksnprintf, PMM_LINE);
+  RUN("pmm", snprintf, PMM_LINE);
+  RUN("pointer", ksnprintf, PTR_LINE);
+  RUN("pointer", snprintf, PTR_LINE);
+  RUN("hex", ksnprintf, HEX_LINE);
+  RUN("hex", snprintf, HEX_LINE);
+  return 0;
+}
@@ -0,0 +1,200 @@
+/* Checks the kernel's kvsnprintf() against the host C library's.
+
+   Each case is one random conversion between literal text: random flags,
+   field width and precision (as digits, as * or absent), a length
+   modifier and a conversion, fed an edge-heavy random value. The output is
+   compared in full and again truncated into a buffer of random size, along
+   with the returned length. Exits non-zero on any mismatch.
+
+   usage: format_test [cases] [seed] */
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <kernel/stdio/kstdio.h>
+
+static uint64_t seed = 0x13198a2e03707344ull;
+static unsigned long failures;
+
+static inline uint64_t xorshift(void)
+{
+  seed ^= seed << 13;
+  seed ^= seed >> 7;
+  seed ^= seed << 17;
+  return seed;
+}
+
+/* Mostly small numbers and the edges of each width, some anything. */
+static uint64_t pick_value(void)
+{
+  static const uint64_t edges[] = {0, 1, 9, 10, 99, 100, 0x7f, 0x80, 0xff, 0x7fff, 0x8000, 0xffff,
+                                   0x7fffffff, 0x80000000u, 0xffffffffu, 0x7fffffffffffffffull,
+                                   0x8000000000000000ull, ~0ull};
+  uint64_t r = xorshift();
+  switch (r & 3)
+  {
+  case 0:
+    return edges[(r >> 8) % (sizeof(edges) / sizeof(edges[0]))] - ((r >> 16) & 1);
+  case 1:
+    return (r >> 8) % 1000;
+  case 2:
+    return -((r >> 8) % 1000);
+  default:
+    return xorshift() >> (r >> 8) % 64;
+  }
+}
+
+static void check(const char *fmt, ...)
+{
+  char want[256], got[256];
+  va_list ap, aq;
+
+  va_start(ap, fmt);
+  va_copy(aq, ap);
+  int want_n = vsnprintf(want, sizeof(want), fmt, ap);
+  int got_n = kvsnprintf(got, sizeof(got), fmt, aq);
+  va_end(aq);
+  va_end(ap);
+  if (want_n != got_n || strcmp(want, got) != 0)
+  {
+    if (failures++ < 10)
+      printf("format_test FAIL fmt=\"%s\" want=\"%s\" (%d) got=\"%s\" (%d)\n", fmt, want, want_n, got, got_n);
+    return;
+  }
+
+  // The same, cut short.
+  size_t size = xorshift() % (want_n + 2);
+  memset(got, 'Z', sizeof(got));
+  va_start(ap, fmt);
+  got_n = kvsnprintf(got, size, fmt, ap);
+  va_end(ap);
+  size_t kept = size == 0 ? 0 : (size_t)want_n < size ? (size_t)want_n : size - 1;
+  if (got_n != want_n || (size && (memcmp(got, want, kept) != 0 || got[kept] != '\0')) || got[size ? kept + 1 : 0] != 'Z')
+    if (failures++ < 10)
+      printf("format_test FAIL truncated fmt=\"%s\" size=%zu\n", fmt, size);
+}
+
+static void one_case(void)
+{
+  static const char *const lengths[] = {"hh", "h", "", "l", "ll", "z", "j", "t"};
+  static const char convs[] = "diuxXcsp%";
+  static const char *const strings[] = {"", "a", "kmalloc-64", "a longer string for width and precision"};
+  char fmt[64];
+  int n = 0;
+
+  fmt[n++] = 'a';
+  fmt[n++] = '%';
+  uint64_t r = xorshift();
+  char conv = convs[r % (sizeof(convs) - 1)];
+  r >>= 8;
+  for (const char *f = "-0+ #"; *f; f++, r >>= 1)
+    if (r & 1)
+      fmt[n++] = *f;
+  // Only the combinations C defines.
+  if (conv == 'c' || conv == 's' || conv == 'p' || conv == 'u' || conv == 'd' || conv == 'i')
+    for (int i = n; i > 2; i--)
+      if (fmt[i - 1] == '#')
+        fmt[i - 1] = '-';
+  if (conv == 'c' || conv == 's' || conv == 'p')
+    for (int i = 2; i < n; i++)
+      if (fmt[i] == '0' || fmt[i] == '+' || fmt[i] == ' ')
+        fmt[i] = '-';
+
+  int width = -1, precision = -1;
+  bool width_star = false, precision_star = false;
+  switch (r & 3)
+  {
+  case 1:
+    width = (r >> 2) % 30;
+    n += sprintf(fmt + n, "%d", width);
+    break;
+  case 2:
+    width_star = true;
+    width = (int)((r >> 2) % 41) - 20;
+    fmt[n++] = '*';
+  }
+  r >>= 8;
+  if (conv != 'c' && conv != 'p' && conv != '%')
+    switch (r & 3)
+    {
+    case 1:
+      precision = (r >> 2) % 25;
+      n += sprintf(fmt + n, ".%d", precision);
+      break;
+    case 2:
+      precision_star = true;
+      precision = (int)((r >> 2) % 31) - 5;
+      fmt[n++] = '.';
+      fmt[n++] = '*';
+    }
+  r >>= 8;
+
+  const char *length = "";
+  if (conv != 'c' && conv != 's' && conv != 'p' && conv != '%')
+    length = lengths[r % 8];
+  r >>= 4;
+  n += sprintf(fmt + n, "%s%cb", length, conv);
+  if (conv == '%')
+  {
+    // No flags, width or precision on %%.
+    n = sprintf(fmt, "a%%%%b");
+    width_star = precision_star = false;
+  }
+
+  uint64_t v = pick_value();
+  const char *str = strings[r % 4];
+
+#define CHECK(arg)                                                  \
+  do                                                                \
+  {                                                                 \
+    if (width_star && precision_star)                               \
+      check(fmt, width, precision, arg);                            \
+    else if (width_star)                                            \
+      check(fmt, width, arg);                                       \
+    else if (precision_star)                                        \
+      check(fmt, precision, arg);                                   \
+    else                                                            \
+      check(fmt, arg);                                              \
+  } while (0)
+
+  if (conv == 's')
+    CHECK(str);
+  else if (conv == 'p')
+    CHECK((void *)(uintptr_t)(v | 1)); // glibc prints (nil) for NULL
+  else if (conv == 'c')
+    CHECK((int)(' ' + v % 95));
+  else if (conv == '%')
+    check(fmt);
+  else if (!strcmp(length, "l") || !strcmp(length, "ll") || !strcmp(length, "z") || !strcmp(length, "j") ||
+           !strcmp(length, "t"))
+    CHECK((long long)v);
+  else
+    CHECK((int)v);
+#undef CHECK
+}
+
+int main(int argc, char **argv)
+{
+  unsigned long cases = 500000;
+  if (argc > 1)
+    cases = strtoul(argv[1], NULL, 0);
+  if (argc > 2)
+    seed = strtoull(argv[2], NULL, 0) | 1;
+
+  // Fixed cases the random ones are unlikely to hit.
+  check("%s|%5s|%-5s|%.2s|%c|%%|%5%|%y", "abc", "ab", "ab", "abc", 'x');
+  check("%d %i %u %x %X %p %zu %lx %#lx %016lx", -42, 42, 42u, 0xbeefu, 0xbeefu, (void *)0x1000,
+        (size_t)4096, 0xffff888000000000ul, 0x10ul, 0xffff888000000000ul);
+  check("%.0d|%.0x|%#.0x|%5.0d|%-5d|%05d|%+d|% d|%+05d", 0, 0u, 0u, 0, 7, -7, 7, 7, -7);
+  check("%lld %llu %hhd %hd", (long long)INT64_MIN, (unsigned long long)UINT64_MAX, 300, 70000);
+
+  for (unsigned long i = 0; i < cases; i++)
+    one_case();
+
+  printf("format_test cases=%lu failures=%lu\n", cases, failures);
+  return failures != 0;
+}
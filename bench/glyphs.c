@@ -0,0 +1,93 @@
+/* Glyph drawing speed with the built-in 32-pixel Zap font.
+
+   Fills a 1920x1080 buffer with text cell by cell, the way the console
+   repaints, using:
+
+     bit_test  the old renderer: one bit test and one store per pixel
+     atlas     psf_draw() in the colours psf_set_colors() pre-rendered
+     spans     psf_draw() in other colours, via the 8-pixel byte table
+
+   and checks that all three draw the same pixels.
+
+   usage: glyphs [screens] */
+
+#include "host.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// psf.h's putc() would clash with the C library's.
+#define putc psf_putc
+#include <kernel/psf/psf.h>
+#undef putc
+
+#define WIDTH 1920
+#define HEIGHT 1080
+
+static uint32_t screen[WIDTH * HEIGHT];
+static uint32_t check[WIDTH * HEIGHT];
+
+static void bit_test(uint32_t *dst, size_t pitch, unsigned int c, uint32_t fg, uint32_t bg)
+{
+  PSF_font *font = (PSF_font *)_binary_zap_ext_light32_psf_start;
+  unsigned int bytesperline = (font->width + 7) / 8;
+  unsigned char *glyph = (unsigned char *)_binary_zap_ext_light32_psf_start + font->headersize +
+                         (c < font->numglyph ? c : 0) * font->bytesperglyph;
+
+  for (unsigned int y = 0; y < font->height; y++)
+  {
+    for (unsigned int x = 0; x < font->width; x++)
+      dst[x] = glyph[x / 8] & (0x80 >> (x % 8)) ? fg : bg;
+    glyph += bytesperline;
+    dst += pitch;
+  }
+}
+
+static unsigned long fill(uint32_t *buf, void (*draw)(uint32_t *, size_t, unsigned int, uint32_t, uint32_t),
+                          unsigned int screen_no, uint32_t fg, uint32_t bg)
+{
+  unsigned int w = psf_width(), h = psf_height();
+  unsigned long glyphs = 0;
+
+  for (unsigned int row = 0; row < HEIGHT / h; row++)
+    for (unsigned int col = 0; col < WIDTH / w; col++, glyphs++)
+      draw(buf + (size_t)row * h * WIDTH + col * w, WIDTH, 32 + (row * 7 + col + screen_no) % 95, fg, bg);
+  return glyphs;
+}
+
+static void run(const char *path, void (*draw)(uint32_t *, size_t, unsigned int, uint32_t, uint32_t),
+                unsigned int screens, uint32_t fg, uint32_t bg)
+{
+  unsigned long glyphs = 0;
+  uint64_t t0 = host_ns();
+  for (unsigned int s = 0; s < screens; s++)
+    glyphs += fill(screen, draw, s, fg, bg);
+  uint64_t ns = host_ns() - t0;
+
+  fill(screen, draw, 0, fg, bg);
+  fill(check, bit_test, 0, fg, bg);
+  int same = memcmp(screen, check, sizeof(screen)) == 0;
+
+  printf("glyphs path=%s width=%u height=%u glyphs=%lu ns=%llu glyphs_per_s=%.0f ns_per_glyph=%.1f match=%d\n",
+         path, psf_width(), psf_height(), glyphs, (unsigned long long)ns, glyphs / (ns / 1e9),
+         (double)ns / glyphs, same);
+  if (!same)
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+  unsigned int screens = 200;
+  if (argc > 1)
+    screens = strtoul(argv[1], NULL, 0);
+
+  host_boot(64ul << 20);
+  psf_init();
+  psf_set_colors(0xaaaaaa, 0x000000);
+
+  run("bit_test", bit_test, screens, 0xaaaaaa, 0x000000);
+  run("atlas", psf_draw, screens, 0xaaaaaa, 0x000000);
+  run("spans", psf_draw, screens, 0xffff55, 0x0000aa);
+  return 0;
+}
@@ -0,0 +1,222 @@
+/* Checks the kernel heap (slab classes and liballoc) end to end.
+
+   A table of live allocations is churned with malloc, realloc, calloc and
+   kmalloc_aligned over sizes from a few bytes to megabytes. Each block is
+   filled with a pattern derived from its slot that must survive until it is
+   freed, including across realloc, so overlapping blocks or a bad copy show
+   up as corruption. Once everything is freed, heap_stats() must show no
+   liballoc bytes in use (objects parked on per-CPU slab stacks still
+   count as slab bytes), and shrinking a large block must return its spare
+   pages. Exits non-zero on any failure.
+
+   usage: heap_test [ops] [seed] */
+
+#include "host.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <kernel/liballoc/liballoc.h>
+
+#define SLOTS 2048
+
+struct slot
+{
+  unsigned char *ptr;
+  size_t size;
+  size_t align;
+};
+
+static uint64_t seed = 0xa4093822299f31d0ull;
+static struct slot slots[SLOTS];
+static unsigned long failures;
+
+static uint64_t rnd(void)
+{
+  seed ^= seed << 13;
+  seed ^= seed >> 7;
+  seed ^= seed << 17;
+  return seed;
+}
+
+#define CHECK(cond, ...)               \
+  do                                   \
+  {                                    \
+    if (!(cond))                       \
+    {                                  \
+      if (failures++ < 20)             \
+      {                                \
+        printf("heap_test FAIL ");     \
+        printf(__VA_ARGS__);           \
+        printf("\n");                  \
+      }                                \
+    }                                  \
+  } while (0)
+
+/* Mostly slab sizes, some liballoc sizes, a few large ones. */
+static size_t rnd_size(void)
+{
+  unsigned int r = rnd() % 32;
+  if (r < 20)
+    return 1 + rnd() % 2100;
+  if (r < 31)
+    return 2049 + rnd() % 200000;
+  return 262145 + rnd() % 3000000;
+}
+
+static inline unsigned char pattern(size_t k, size_t i)
+{
+  return (unsigned char)(k * 31 + i);
+}
+
+/* Large blocks are only sampled to keep the run short. */
+static inline size_t stride(size_t size)
+{
+  return size > 4096 ? 997 : 1;
+}
+
+static void fill(size_t k, size_t from)
+{
+  for (size_t i = from; i < slots[k].size; i++)
+    slots[k].ptr[i] = pattern(k, i);
+}
+
+static void verify(size_t k, size_t size, const char *what)
+{
+  for (size_t i = 0; i < size; i += stride(size))
+    if (slots[k].ptr[i] != pattern(k, i))
+    {
+      CHECK(0, "%s slot %zu size %zu corrupt at byte %zu", what, k, slots[k].size, i);
+      return;
+    }
+}
+
+static void check_new(size_t k, const char *what)
+{
+  struct slot *s = &slots[k];
+  CHECK(s->ptr != NULL, "%s of %zu bytes failed", what, s->size);
+  if (!s->ptr)
+    return;
+  CHECK((uintptr_t)s->ptr % s->align == 0, "%s of %zu bytes at %p not aligned to %zu", what, s->size,
+        (void *)s->ptr, s->align);
+  CHECK(lb_malloc_usable_size(s->ptr) >= s->size, "%s of %zu bytes has usable size %zu", what, s->size,
+        lb_malloc_usable_size(s->ptr));
+}
+
+static void step(size_t k)
+{
+  struct slot *s = &slots[k];
+
+  if (s->ptr)
+  {
+    verify(k, s->size, "before free");
+    unsigned int r = rnd() % 4;
+    if (r != 0)
+    {
+      lb_free(s->ptr);
+      s->ptr = NULL;
+      return;
+    }
+
+    // realloc keeps the old contents up to the smaller size but not the
+    // alignment kmalloc_aligned gave.
+    size_t size = (rnd() % 3) ? rnd() % 5000 : rnd() % 600000;
+    size_t keep = size < s->size ? size : s->size;
+    unsigned char *p = lb_realloc(s->ptr, size);
+    if (size == 0)
+    {
+      s->ptr = NULL;
+      return;
+    }
+    s->ptr = p;
+    s->size = size;
+    s->align = 16;
+    check_new(k, "realloc");
+    if (!p)
+      return;
+    verify(k, keep, "realloc");
+    fill(k, keep);
+    return;
+  }
+
+  s->size = rnd_size();
+  s->align = 16;
+  switch (rnd() % 8)
+  {
+  case 0:
+    s->ptr = lb_calloc(1, s->size);
+    check_new(k, "calloc");
+    for (size_t i = 0; s->ptr && i < s->size; i++)
+      if (s->ptr[i])
+      {
+        CHECK(0, "calloc of %zu bytes not zeroed at byte %zu", s->size, i);
+        break;
+      }
+    break;
+  case 1:
+    s->align = 1ul << (rnd() % 17);
+    s->ptr = kmalloc_aligned(s->size, s->align);
+    check_new(k, "kmalloc_aligned");
+    break;
+  default:
+    s->ptr = lb_malloc(s->size);
+    check_new(k, "malloc");
+  }
+  if (s->ptr)
+    fill(k, 0);
+}
+
+int main(int argc, char **argv)
+{
+  unsigned long ops = 400000;
+  if (argc > 1)
+    ops = strtoul(argv[1], NULL, 0);
+  if (argc > 2)
+    seed = strtoull(argv[2], NULL, 0) | 1;
+
+  host_boot(1ul << 30);
+
+  for (unsigned long i = 0; i < ops; i++)
+    step(rnd() % SLOTS);
+
+  for (size_t k = 0; k < SLOTS; k++)
+  {
+    if (slots[k].ptr)
+      verify(k, slots[k].size, "before free");
+    lb_free(slots[k].ptr);
+    slots[k].ptr = NULL;
+  }
+
+  // Shrinking a large block in place must give its spare pages back.
+  struct heap_stats st;
+  unsigned char *big = lb_malloc(4ul << 20);
+  memset(big, 0x5a, 300ul << 10);
+  heap_stats(&st);
+  size_t reserved = st.bytes_reserved;
+  unsigned char *small = lb_realloc(big, 300ul << 10);
+  heap_stats(&st);
+  CHECK(small == big, "large shrink moved the block");
+  CHECK(reserved - st.bytes_reserved >= (4ul << 20) - (304ul << 10),
+        "large shrink kept %zu of %zu reserved bytes", st.bytes_reserved, reserved);
+  for (size_t i = 0; i < (300ul << 10); i++)
+    if (small[i] != 0x5a)
+    {
+      CHECK(0, "large shrink lost byte %zu", i);
+      break;
+    }
+  lb_free(small);
+
+  // Through a volatile so the compiler does not reject the overflow itself.
+  volatile size_t huge = (size_t)1 << 62;
+  CHECK(lb_calloc(huge, 8) == NULL, "calloc size overflow not caught");
+
+  heap_stats(&st);
+  CHECK(st.bytes_in_use == 0, "%zu bytes still in use after freeing everything", st.bytes_in_use);
+  CHECK(st.allocs == st.frees, "%llu allocs but %llu frees", (unsigned long long)st.allocs,
+        (unsigned long long)st.frees);
+
+  printf("heap_test ops=%lu peak_in_use=%zu peak_reserved=%zu failures=%lu\n", ops, st.peak_in_use,
+         st.peak_reserved, failures);
+  return failures != 0;
+}
@@ -0,0 +1,129 @@
+/* Host environment for the benchmarks: a fake Limine memory map and HHDM
+   over a block of host memory, plus the hooks kmain normally provides.
+
+   pmm.c is included rather than linked so the Limine request structures it
+   owns can be filled in before pmm_init_after_kernel() reads them. */
+
+#include "host.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/mman.h>
+
+#include <kernel/acpi/acpi.h>
+#include <kernel/liballoc/liballoc.h>
+#include <kernel/slab/slab.h>
+#include <kernel/spinlock/spinlock.h>
+
+#include "../kernel/src/pmm/pmm.c"
+#include "../kernel/src/numa/numa.c"
+
+_Thread_local unsigned int host_cpu;
+struct cpu_local host_cpu_locals[MAX_CPUS];
+
+char _kernel_end;
+
+/* No firmware tables on the host: one NUMA node. */
+struct acpi_sdt_header *acpi_find_table(const char *signature)
+{
+  (void)signature;
+  return NULL;
+}
+
+static spinlock_t host_liballoc_lock = SPINLOCK_INIT;
+
+int liballoc_lock(void)
+{
+  spin_lock(&host_liballoc_lock);
+  return 0;
+}
+
+int liballoc_unlock(void)
+{
+  spin_unlock(&host_liballoc_lock);
+  return 0;
+}
+
+void *liballoc_alloc(size_t pages)
+{
+  uintptr_t phys = pmm_alloc_pages(pages);
+  return phys ? phys_to_virt(phys) : NULL;
+}
+
+void *liballoc_alloc_aligned(size_t pages, size_t align)
+{
+  uintptr_t phys = pmm_alloc_aligned(pages, align);
+  return phys ? phys_to_virt(phys) : NULL;
+}
+
+int liballoc_free(void *ptr, size_t pages)
+{
+  pmm_free_pages(virt_to_phys(ptr), pages);
+  return 0;
+}
+
+void host_boot(size_t bytes)
+{
+  static struct limine_hhdm_response hhdm;
+  static struct limine_memmap_entry entries[2];
+  static struct limine_memmap_entry *entry_ptrs[2] = {&entries[0], &entries[1]};
+  static struct limine_memmap_response memmap = {0, 2, entry_ptrs};
+
+  bytes = align_up(bytes, 4ul << 20);
+  // mmap rather than the C library allocator, whose names liballoc takes.
+  unsigned char *mem = mmap(NULL, bytes + (4ul << 20), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (mem == MAP_FAILED)
+  {
+    fprintf(stderr, "host_boot: cannot get %zu bytes\n", bytes);
+    exit(1);
+  }
+  mem = (unsigned char *)align_up((uintptr_t)mem, 4ul << 20);
+  // Fault the whole block in now so no benchmark pays for first touches.
+  memset(mem, 0, bytes);
+
+  // Physical address 0 is the HHDM base; keep page 0 out like a real
+  // firmware map would and put a reserved hole at 1 MiB.
+  entries[0] = (struct limine_memmap_entry){0x1000, 0x9f000 - 0x1000, LIMINE_MEMMAP_USABLE};
+  entries[1] = (struct limine_memmap_entry){0x100000, bytes - 0x100000, LIMINE_MEMMAP_USABLE};
+  hhdm.offset = (uint64_t)(uintptr_t)mem;
+  hhdm_req.response = &hhdm;
+  memmap_req.response = &memmap;
+
+  pmm_init_after_kernel();
+  while (pmm_deferred_init_step(1u << 20))
+    ;
+  kmem_init();
+}
+
+void host_print_heap_stats(const char *name)
+{
+  struct heap_stats st;
+  heap_stats(&st);
+
+  printf("%s heap in_use=%zu reserved=%zu peak_in_use=%zu peak_reserved=%zu\n", name,
+         st.bytes_in_use, st.bytes_reserved, st.peak_in_use, st.peak_reserved);
+  printf("%s heap allocs=%llu frees=%llu large_allocs=%llu large_frees=%llu"
+         " pages_taken=%llu pages_returned=%llu\n", name,
+         (unsigned long long)st.allocs, (unsigned long long)st.frees,
+         (unsigned long long)st.large_allocs, (unsigned long long)st.large_frees,
+         (unsigned long long)st.pages_taken, (unsigned long long)st.pages_returned);
+  printf("%s heap splits=%llu melts=%llu realloc_in_place=%llu realloc_moved=%llu\n", name,
+         (unsigned long long)st.splits, (unsigned long long)st.melts,
+         (unsigned long long)st.realloc_in_place, (unsigned long long)st.realloc_moved);
+  printf("%s heap slab_in_use=%zu slab_reserved=%zu slab_cpu_hits=%llu slab_cpu_misses=%llu\n", name,
+         st.slab_bytes_in_use, st.slab_bytes_reserved,
+         (unsigned long long)st.slab_cpu_hits, (unsigned long long)st.slab_cpu_misses);
+  for (int i = 0; i < LIBALLOC_MAXEXP; i++)
+    if (st.allocs_by_exp[i] || st.free_tags[i] || st.complete_pages[i])
+      printf("%s heap exp=%d allocs=%llu free_tags=%zu complete_pages=%d\n", name, i,
+             (unsigned long long)st.allocs_by_exp[i], st.free_tags[i], st.complete_pages[i]);
+}
+
+uint64_t host_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
@@ -0,0 +1,24 @@
+#ifndef _H_BENCH_HOST
+#define _H_BENCH_HOST 1
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* liballoc is built with its entry points renamed so it does not replace
+   the host C library's allocator. */
+void *lb_malloc(size_t size);
+void *lb_realloc(void *ptr, size_t size);
+void *lb_calloc(size_t nobj, size_t size);
+void lb_free(void *ptr);
+
+/* Boot the PMM and the slab layer on `bytes` of host memory laid out as a
+   Limine memory map, the way kmain does on real hardware. */
+void host_boot(size_t bytes);
+
+/* Print a heap_stats() snapshot as key=value lines prefixed with `name`. */
+void host_print_heap_stats(const char *name);
+
+/* Nanoseconds from a monotonic clock. */
+uint64_t host_ns(void);
+
+#endif
@@ -0,0 +1,72 @@
+#ifndef _H_CPU
+#define _H_CPU 1
+
+/* Host stand-in for the kernel's <kernel/cpu/cpu.h>. The benchmarks compile
+   kernel sources as ordinary user-space code; every thread plays one CPU and
+   sets host_cpu to its index before touching the allocators. */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+
+#define MAX_CPUS 64
+#define CACHE_LINE_SIZE 64
+
+#define __cacheline_aligned __attribute__((aligned(CACHE_LINE_SIZE)))
+
+extern _Thread_local unsigned int host_cpu;
+
+/* Same layout as the kernel's; host.c keeps one per CPU index, all on node
+   0 like everything else on the host. */
+struct cpu_local
+{
+  struct cpu_local *self;
+  unsigned int id;
+  unsigned int node;
+  uint64_t hw_id;
+  void *stack_top;
+} __cacheline_aligned;
+
+extern struct cpu_local host_cpu_locals[MAX_CPUS];
+
+static inline struct cpu_local *this_cpu(void)
+{
+  return &host_cpu_locals[host_cpu];
+}
+
+static inline unsigned int cpu_id(void)
+{
+  return host_cpu;
+}
+
+/* A thread is never interrupted by another user of its CPU's data, so
+   there is nothing to mask. */
+static inline unsigned long irq_save(void)
+{
+  return 0;
+}
+
+static inline void irq_restore(unsigned long flags)
+{
+  (void)flags;
+}
+
+static inline uint64_t cpu_timestamp(void)
+{
+#if defined(__x86_64__)
+  return __builtin_ia32_rdtsc();
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+#endif
+}
+
+static inline void cpu_relax(void)
+{
+#if defined(__x86_64__)
+  __builtin_ia32_pause();
+#endif
+}
+
+#endif
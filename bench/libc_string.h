@@ -0,0 +1,24 @@
+#ifndef _H_BENCH_LIBC_STRING
+#define _H_BENCH_LIBC_STRING 1
+
+#include <stddef.h>
+
+/* The kernel libc's string routines, built with every name prefixed by
+   libc_ (see LIBC_RENAME in GNUmakefile) so the host C library's stay
+   available to compare against. */
+void *libc_memcpy(void *restrict dest, const void *restrict src, size_t n);
+void *libc_memset(void *s, int c, size_t n);
+void *libc_memmove(void *dest, const void *src, size_t n);
+int libc_memcmp(const void *s1, const void *s2, size_t n);
+void *libc_memchr(const void *s, int c, size_t n);
+
+size_t libc_strlen(const char *s);
+size_t libc_strnlen(const char *s, size_t maxlen);
+int libc_strcmp(const char *s1, const char *s2);
+int libc_strncmp(const char *s1, const char *s2, size_t n);
+char *libc_strcpy(char *restrict dest, const char *restrict src);
+char *libc_strncpy(char *restrict dest, const char *restrict src, size_t n);
+char *libc_strchr(const char *s, int c);
+char *libc_strrchr(const char *s, int c);
+
+#endif
@@ -0,0 +1,86 @@
+/* malloc/free throughput on one CPU for different size mixes.
+
+   A window of live objects is churned: free a random slot, malloc a new
+   size from the mix into it. Each mix moves about the same number of bytes
+   so the large ones finish too. One line per mix.
+
+   usage: malloc_mix [ops] */
+
+#include "host.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define WINDOW 1024
+
+struct mix
+{
+  const char *name;
+  size_t min, max; // uniform sizes in [min, max]
+};
+
+static const struct mix mixes[] = {
+    {"tiny", 8, 64},
+    {"small", 64, 512},
+    {"slab", 16, 2048},
+    {"medium", 2049, 65536},
+    {"large", 262145, 1048576},
+};
+
+static uint64_t seed = 0x9e3779b97f4a7c15ull;
+
+static inline uint64_t xorshift(void)
+{
+  seed ^= seed << 13;
+  seed ^= seed >> 7;
+  seed ^= seed << 17;
+  return seed;
+}
+
+int main(int argc, char **argv)
+{
+  unsigned long ops = 2000000;
+  if (argc > 1)
+    ops = strtoul(argv[1], NULL, 0);
+
+  host_boot(1ul << 30);
+
+  static void *live[WINDOW];
+  for (size_t m = 0; m < sizeof(mixes) / sizeof(mixes[0]); m++)
+  {
+    const struct mix *mix = &mixes[m];
+    size_t span = mix->max - mix->min + 1;
+    unsigned long n = ops;
+    // Cap the bytes moved at what `ops` small objects would be.
+    if ((mix->min + mix->max) / 2 > 512)
+      n = ops / ((mix->min + mix->max) / 2 / 512);
+
+    uint64_t t0 = host_ns();
+    for (unsigned long i = 0; i < n; i++)
+    {
+      unsigned int slot = xorshift() % WINDOW;
+      lb_free(live[slot]);
+      live[slot] = lb_malloc(mix->min + xorshift() % span);
+      if (!live[slot])
+      {
+        fprintf(stderr, "malloc_mix %s: out of memory\n", mix->name);
+        return 1;
+      }
+      *(volatile char *)live[slot] = (char)i;
+    }
+    uint64_t ns = host_ns() - t0;
+
+    for (unsigned int slot = 0; slot < WINDOW; slot++)
+    {
+      lb_free(live[slot]);
+      live[slot] = NULL;
+    }
+
+    // Each op is one free plus one malloc.
+    printf("malloc_mix mix=%s min=%zu max=%zu ops=%lu ns=%llu mops_per_s=%.2f\n",
+           mix->name, mix->min, mix->max, n * 2, (unsigned long long)ns, n * 2 / (ns / 1e3));
+  }
+
+  host_print_heap_stats("malloc_mix");
+  return 0;
+}
@@ -0,0 +1,106 @@
+/* malloc/free throughput as the number of CPUs grows.
+
+   Each thread plays one CPU and churns a private window of live objects:
+   free a random slot, malloc a new size into it. Sizes are skewed towards
+   small objects, the way kernel allocations are. One line of results per
+   CPU count.
+
+   usage: malloc_smp [max_cpus] [ops_per_cpu] */
+
+#include "host.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <kernel/cpu/cpu.h>
+
+#define WINDOW 256
+
+static unsigned long ops_per_cpu = 2000000;
+static pthread_barrier_t start_line;
+
+static inline uint64_t xorshift(uint64_t *s)
+{
+  *s ^= *s << 13;
+  *s ^= *s >> 7;
+  *s ^= *s << 17;
+  return *s;
+}
+
+/* Mostly <= 128 bytes, some up to 2 KiB. */
+static inline size_t pick_size(uint64_t *s)
+{
+  uint64_t r = xorshift(s);
+  if ((r & 7) != 0)
+    return 8 + (r >> 8) % 121;
+  return 129 + (r >> 8) % 1920;
+}
+
+static void *worker(void *arg)
+{
+  unsigned int cpu = (unsigned int)(uintptr_t)arg;
+  host_cpu = cpu;
+
+  void *live[WINDOW] = {0};
+  uint64_t seed = 0x9e3779b97f4a7c15ull * (cpu + 1);
+
+  pthread_barrier_wait(&start_line);
+  for (unsigned long i = 0; i < ops_per_cpu; i++)
+  {
+    unsigned int slot = xorshift(&seed) % WINDOW;
+    lb_free(live[slot]);
+    live[slot] = lb_malloc(pick_size(&seed));
+    if (!live[slot])
+    {
+      fprintf(stderr, "cpu %u: out of memory\n", cpu);
+      exit(1);
+    }
+    *(volatile char *)live[slot] = (char)i;
+  }
+  for (unsigned int slot = 0; slot < WINDOW; slot++)
+    lb_free(live[slot]);
+  return NULL;
+}
+
+int main(int argc, char **argv)
+{
+  unsigned int max_cpus = 8;
+  if (argc > 1)
+    max_cpus = strtoul(argv[1], NULL, 0);
+  if (argc > 2)
+    ops_per_cpu = strtoul(argv[2], NULL, 0);
+  if (max_cpus < 1 || max_cpus > MAX_CPUS)
+    max_cpus = MAX_CPUS;
+
+  host_boot(512ul << 20);
+
+  pthread_t threads[MAX_CPUS];
+  double base = 0;
+  for (unsigned int cpus = 1; cpus <= max_cpus; cpus *= 2)
+  {
+    pthread_barrier_init(&start_line, NULL, cpus + 1);
+    for (unsigned int c = 0; c < cpus; c++)
+      pthread_create(&threads[c], NULL, worker, (void *)(uintptr_t)c);
+
+    pthread_barrier_wait(&start_line);
+    uint64_t t0 = host_ns();
+    for (unsigned int c = 0; c < cpus; c++)
+      pthread_join(threads[c], NULL);
+    uint64_t ns = host_ns() - t0;
+    pthread_barrier_destroy(&start_line);
+
+    // Each op is one free plus one malloc.
+    double mops = (double)cpus * ops_per_cpu * 2 / (ns / 1e3);
+    if (cpus == 1)
+      base = mops;
+    printf("malloc_smp cpus=%u ops=%lu ns=%llu mops_per_s=%.2f scaling=%.2f\n",
+           cpus, (unsigned long)cpus * ops_per_cpu * 2, (unsigned long long)ns, mops, mops / base);
+
+    if (cpus < max_cpus && cpus * 2 > max_cpus)
+      cpus = max_cpus / 2;
+  }
+
+  host_print_heap_stats("malloc_smp");
+  return 0;
+}
@@ -0,0 +1,181 @@
+/* Throughput of memcpy, memset and memmove: the libc routines, each of the
+   variants they are built from, and the host C library's for reference.
+
+   Every size runs with source and destination aligned, then with both
+   misaligned by different amounts. memmove moves a buffer up by a quarter
+   of its size, the overlapping case that has to copy backwards. Sizes up
+   to MAX_SIZE stay in cache; the largest shows memory bandwidth.
+
+   usage: memops [bytes_per_point] */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/mman.h>
+
+#include "memops_variants.h"
+#include "../libc/string/memops.h"
+
+#define MAX_SIZE (8ul << 20)
+
+static unsigned char *buf;
+static unsigned long bytes_per_point = 1ul << 28;
+
+static uint64_t now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+static void host_copy(void *dest, const void *src, size_t n)
+{
+  memcpy(dest, src, n);
+}
+
+static void host_move(void *dest, const void *src, size_t n)
+{
+  memmove(dest, src, n);
+}
+
+static void host_set(void *dest, int c, size_t n)
+{
+  memset(dest, c, n);
+}
+
+static void libc_copy(void *dest, const void *src, size_t n)
+{
+  libc_memcpy(dest, src, n);
+}
+
+static void libc_move(void *dest, const void *src, size_t n)
+{
+  libc_memmove(dest, src, n);
+}
+
+static void libc_set(void *dest, int c, size_t n)
+{
+  libc_memset(dest, c, n);
+}
+
+struct copy_impl
+{
+  const char *name;
+  void (*fn)(void *, const void *, size_t);
+};
+
+struct set_impl
+{
+  const char *name;
+  void (*fn)(void *, int, size_t);
+};
+
+static const struct copy_impl copies[] = {
+    {"libc", libc_copy},
+    {"bytes", copy_bytes},
+    {"words", copy_words},
+#if defined(__x86_64__)
+    {"movsq", copy_movsq},
+    {"movsb", copy_movsb},
+#endif
+    {"host", host_copy},
+};
+
+static const struct copy_impl moves[] = {
+    {"libc", libc_move},
+    {"bytes_backward", copy_bytes_backward},
+    {"words_backward", copy_words_backward},
+    {"host", host_move},
+};
+
+static const struct set_impl sets[] = {
+    {"libc", libc_set},
+    {"bytes", set_bytes},
+    {"words", set_words},
+#if defined(__x86_64__)
+    {"stosq", set_stosq},
+    {"stosb", set_stosb},
+#endif
+    {"host", host_set},
+};
+
+static const size_t sizes[] = {8, 32, 64, 128, 256, 512, 1024, 4096, 16384, 65536, 1ul << 20, MAX_SIZE};
+
+static unsigned long reps_for(size_t size)
+{
+  unsigned long reps = bytes_per_point / size;
+  return reps ? reps : 1;
+}
+
+static void report(const char *op, const char *impl, size_t size, unsigned int misalign, unsigned long reps, uint64_t ns)
+{
+  printf("memops op=%s impl=%s size=%zu misalign=%u gb_per_s=%.2f\n",
+         op, impl, size, misalign, (double)size * reps / ns);
+}
+
+int main(int argc, char **argv)
+{
+  if (argc > 1)
+    bytes_per_point = strtoul(argv[1], NULL, 0);
+
+  buf = mmap(NULL, 2 * MAX_SIZE + 4096, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (buf == MAP_FAILED)
+  {
+    perror("mmap");
+    return 1;
+  }
+  memset(buf, 0x5a, 2 * MAX_SIZE + 4096);
+
+  unsigned int features = cpu_string_features();
+  printf("memops erms=%d fsrm=%d\n", !!(features & MEMOPS_ERMS), !!(features & MEMOPS_FSRM));
+
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+  {
+    size_t size = sizes[i];
+    unsigned long reps = reps_for(size);
+
+    for (unsigned int misalign = 0; misalign <= 1; misalign++)
+    {
+      unsigned char *dst = buf + (misalign ? 3 : 0);
+      unsigned char *src = buf + MAX_SIZE + 2048 + (misalign ? 13 : 0);
+
+      for (size_t k = 0; k < sizeof(copies) / sizeof(copies[0]); k++)
+      {
+        uint64_t t0 = now_ns();
+        for (unsigned long r = 0; r < reps; r++)
+        {
+          copies[k].fn(dst, src, size);
+          __asm__ __volatile__("" ::: "memory");
+        }
+        report("memcpy", copies[k].name, size, misalign, reps, now_ns() - t0);
+      }
+
+      for (size_t k = 0; k < sizeof(sets) / sizeof(sets[0]); k++)
+      {
+        uint64_t t0 = now_ns();
+        for (unsigned long r = 0; r < reps; r++)
+        {
+          sets[k].fn(dst, (int)r, size);
+          __asm__ __volatile__("" ::: "memory");
+        }
+        report("memset", sets[k].name, size, misalign, reps, now_ns() - t0);
+      }
+
+      // Move up by a quarter: the ranges overlap, so this copies backwards.
+      size_t shift = size / 4 ? size / 4 : 1;
+      for (size_t k = 0; k < sizeof(moves) / sizeof(moves[0]); k++)
+      {
+        uint64_t t0 = now_ns();
+        for (unsigned long r = 0; r < reps; r++)
+        {
+          moves[k].fn(dst + shift, dst, size);
+          __asm__ __volatile__("" ::: "memory");
+        }
+        report("memmove", moves[k].name, size, misalign, reps, now_ns() - t0);
+      }
+    }
+  }
+  return 0;
+}
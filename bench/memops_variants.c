@@ -0,0 +1,71 @@
+/* Each memops.h building block as an out-of-line function, so memops.c can
+   time them one by one. Compiled with the kernel's libc flags (see
+   LIBC_CFLAGS in GNUmakefile). */
+
+#include "../libc/string/memops.h"
+
+#include "memops_variants.h"
+
+void copy_bytes(void *dest, const void *src, size_t n)
+{
+  memops_copy_bytes(dest, src, n);
+}
+
+void copy_words(void *dest, const void *src, size_t n)
+{
+  memops_copy_words(dest, src, n);
+}
+
+void copy_words_backward(void *dest, const void *src, size_t n)
+{
+  memops_copy_words_backward(dest, src, n);
+}
+
+/* The backward byte loop memmove used before the word loops. */
+void copy_bytes_backward(void *dest, const void *src, size_t n)
+{
+  unsigned char *d = dest;
+  const unsigned char *s = src;
+
+  for (size_t i = n; i > 0; i--)
+  {
+    d[i - 1] = s[i - 1];
+  }
+}
+
+void set_bytes(void *dest, int c, size_t n)
+{
+  memops_set_bytes(dest, (unsigned char)c, n);
+}
+
+void set_words(void *dest, int c, size_t n)
+{
+  memops_set_words(dest, (unsigned char)c, n);
+}
+
+#if defined(__x86_64__)
+void copy_movsq(void *dest, const void *src, size_t n)
+{
+  memops_movsq(dest, src, n);
+}
+
+void copy_movsb(void *dest, const void *src, size_t n)
+{
+  memops_movsb(dest, src, n);
+}
+
+void set_stosq(void *dest, int c, size_t n)
+{
+  memops_stosq(dest, (unsigned char)c, n);
+}
+
+void set_stosb(void *dest, int c, size_t n)
+{
+  memops_stosb(dest, (unsigned char)c, n);
+}
+#endif
+
+unsigned int cpu_string_features(void)
+{
+  return memops_features();
+}
@@ -0,0 +1,25 @@
+#ifndef _H_BENCH_MEMOPS_VARIANTS
+#define _H_BENCH_MEMOPS_VARIANTS 1
+
+#include <stddef.h>
+
+#include "libc_string.h"
+
+/* The building blocks of libc_memcpy, libc_memset and libc_memmove. */
+void copy_bytes(void *dest, const void *src, size_t n);
+void copy_words(void *dest, const void *src, size_t n);
+void copy_words_backward(void *dest, const void *src, size_t n);
+void copy_bytes_backward(void *dest, const void *src, size_t n);
+void set_bytes(void *dest, int c, size_t n);
+void set_words(void *dest, int c, size_t n);
+#if defined(__x86_64__)
+void copy_movsq(void *dest, const void *src, size_t n);
+void copy_movsb(void *dest, const void *src, size_t n);
+void set_stosq(void *dest, int c, size_t n);
+void set_stosb(void *dest, int c, size_t n);
+#endif
+
+/* MEMOPS_* feature bits of this CPU. */
+unsigned int cpu_string_features(void);
+
+#endif
@@ -0,0 +1,103 @@
+/* PMM allocation and free latency as memory fragments.
+
+   Memory is filled with single pages, then all of them but a random
+   `pinned` fraction are freed again, leaving pinned pages scattered over
+   the large blocks. At each level, batches of blocks of each order are
+   allocated and then freed; a line reports the mean nanoseconds per alloc
+   and per free and how many allocs failed. Higher orders start failing
+   once no block of that size is left whole.
+
+   usage: pmm_frag [rounds] */
+
+#include "host.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <kernel/pmm/pmm.h>
+
+#define BATCH 256
+#define MEMORY (256ul << 20)
+
+static uint64_t seed = 0x2545f4914f6cdd1dull;
+
+static uint64_t xorshift(void)
+{
+  seed ^= seed << 13;
+  seed ^= seed >> 7;
+  seed ^= seed << 17;
+  return seed;
+}
+
+int main(int argc, char **argv)
+{
+  unsigned int rounds = 20;
+  if (argc > 1)
+    rounds = strtoul(argv[1], NULL, 0);
+
+  host_boot(MEMORY);
+
+  static uintptr_t pages[MEMORY / 4096];
+  struct pmm_stats st;
+
+  // Pinned pages per thousand.
+  static const unsigned int levels[] = {0, 1, 10, 100, 500};
+  static const unsigned int orders[] = {0, 3, 9};
+
+  for (size_t l = 0; l < sizeof(levels) / sizeof(levels[0]); l++)
+  {
+    size_t count = 0, pinned = 0;
+    uintptr_t phys;
+    while (count < MEMORY / 4096 && (phys = pmm_alloc_order(0)) != 0)
+      pages[count++] = phys;
+    for (size_t i = 0; i < count; i++)
+    {
+      if (xorshift() % 1000 < levels[l])
+        pages[pinned++] = pages[i];
+      else
+        pmm_free_pages(pages[i], 1);
+    }
+
+    for (size_t o = 0; o < sizeof(orders) / sizeof(orders[0]); o++)
+    {
+      unsigned int order = orders[o];
+      uintptr_t batch[BATCH];
+      // A batch never asks for more than a quarter of memory.
+      unsigned int n = BATCH;
+      if (n > MEMORY / 4 / (4096ul << order))
+        n = MEMORY / 4 / (4096ul << order);
+      uint64_t alloc_ns = 0, free_ns = 0;
+      unsigned long allocs = 0, failed = 0;
+
+      for (unsigned int r = 0; r < rounds; r++)
+      {
+        uint64_t t0 = host_ns();
+        for (unsigned int i = 0; i < n; i++)
+          batch[i] = pmm_alloc_order(order);
+        uint64_t t1 = host_ns();
+        for (unsigned int i = 0; i < n; i++)
+        {
+          if (batch[i])
+            pmm_free_order(batch[i], order);
+          else
+            failed++;
+        }
+        uint64_t t2 = host_ns();
+
+        alloc_ns += t1 - t0;
+        free_ns += t2 - t1;
+        allocs += n;
+      }
+
+      pmm_get_stats(&st);
+      printf("pmm_frag pinned_per_mille=%u order=%u allocs=%lu failed=%lu alloc_ns=%.1f free_ns=%.1f free_pages=%zu\n",
+             levels[l], order, allocs, failed, (double)alloc_ns / allocs,
+             allocs > failed ? (double)free_ns / (allocs - failed) : 0.0, st.free_pages);
+    }
+
+    for (size_t i = 0; i < pinned; i++)
+      pmm_free_pages(pages[i], 1);
+  }
+
+  return 0;
+}
@@ -0,0 +1,219 @@
+/* Checks the PMM's allocators against a shadow map of the pages handed out.
+
+   Random allocations of every kind (page runs, buddy orders, aligned runs,
+   zone-restricted blocks, huge chunks) are mixed with random frees. Every
+   block must lie in usable memory, meet its alignment and zone, and not
+   overlap anything still allocated. At the end all of it is freed and the
+   allocator must hand out as many pages as it did before. A page freed
+   twice must come back only once. Exits non-zero on any failure.
+
+   usage: pmm_test [ops] [seed] */
+
+#include "host.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <kernel/pmm/pmm.h>
+
+#define MEMORY (128ul << 20)
+#define PAGES (MEMORY / 4096)
+#define LIVE 512
+
+enum kind
+{
+  RUN,
+  ORDER,
+  ALIGNED,
+  DMA,
+  HUGE,
+  KINDS
+};
+
+static const char *kind_names[KINDS] = {"run", "order", "aligned", "dma", "huge"};
+
+struct block
+{
+  uintptr_t phys;
+  size_t pages;
+  unsigned int order;
+  enum kind kind;
+};
+
+static uint64_t seed = 0x13198a2e03707344ull;
+static unsigned char shadow[PAGES];
+static struct block live[LIVE];
+static unsigned long failures;
+
+static uint64_t rnd(void)
+{
+  seed ^= seed << 13;
+  seed ^= seed >> 7;
+  seed ^= seed << 17;
+  return seed;
+}
+
+#define CHECK(cond, ...)               \
+  do                                   \
+  {                                    \
+    if (!(cond))                       \
+    {                                  \
+      if (failures++ < 20)             \
+      {                                \
+        printf("pmm_test FAIL ");      \
+        printf(__VA_ARGS__);           \
+        printf("\n");                  \
+      }                                \
+    }                                  \
+  } while (0)
+
+/* Pages the allocator can hand out, counted by taking all of them. */
+static size_t drain_count(void)
+{
+  static uintptr_t pages[PAGES];
+  size_t n = 0;
+  uintptr_t phys;
+  while (n < PAGES && (phys = pmm_alloc_order(0)) != 0)
+    pages[n++] = phys;
+  for (size_t i = 0; i < n; i++)
+    pmm_free_order(pages[i], 0);
+  return n;
+}
+
+static int usable(uintptr_t phys, size_t pages)
+{
+  uintptr_t end = phys + pages * 4096;
+  return (phys >= 0x1000 && end <= 0x9f000) || (phys >= 0x100000 && end <= MEMORY);
+}
+
+static void take(struct block *b, size_t align)
+{
+  const char *name = kind_names[b->kind];
+  CHECK(usable(b->phys, b->pages), "%s %#lx+%zu pages outside usable memory", name,
+        (unsigned long)b->phys, b->pages);
+  CHECK(b->phys % align == 0, "%s %#lx not aligned to %#zx", name, (unsigned long)b->phys, align);
+  if (b->kind == DMA)
+    CHECK(b->phys + b->pages * 4096 <= 16ul << 20, "dma %#lx above 16 MiB", (unsigned long)b->phys);
+  if (!usable(b->phys, b->pages))
+    return;
+  for (size_t i = 0; i < b->pages; i++)
+  {
+    size_t pfn = b->phys / 4096 + i;
+    CHECK(!shadow[pfn], "%s %#lx+%zu pages overlaps page %#lx", name, (unsigned long)b->phys,
+          b->pages, (unsigned long)pfn * 4096);
+    shadow[pfn] = 1;
+  }
+}
+
+static void release(struct block *b)
+{
+  if (usable(b->phys, b->pages))
+    for (size_t i = 0; i < b->pages; i++)
+      shadow[b->phys / 4096 + i] = 0;
+
+  switch (b->kind)
+  {
+  case ORDER:
+  case DMA:
+    pmm_free_order(b->phys, b->order);
+    break;
+  case HUGE:
+    pmm_huge_free(b->phys);
+    break;
+  default:
+    pmm_free_pages(b->phys, b->pages);
+  }
+  b->phys = 0;
+}
+
+static void allocate(struct block *b)
+{
+  size_t align = 4096;
+  b->kind = rnd() % KINDS;
+  b->order = 0;
+
+  switch (b->kind)
+  {
+  case RUN:
+    b->pages = 1 + rnd() % ((rnd() & 3) ? 8 : 700);
+    b->phys = pmm_alloc_pages(b->pages);
+    break;
+  case ORDER:
+    b->order = rnd() % (PMM_MAX_ORDER + 1);
+    b->pages = 1ul << b->order;
+    align = b->pages * 4096;
+    b->phys = pmm_alloc_order(b->order);
+    break;
+  case ALIGNED:
+    b->pages = 1 + rnd() % 40;
+    align = 4096ul << rnd() % 10;
+    b->phys = pmm_alloc_aligned(b->pages, align);
+    break;
+  case DMA:
+    b->order = rnd() % 4;
+    b->pages = 1ul << b->order;
+    align = b->pages * 4096;
+    b->phys = pmm_alloc_order_flags(b->order, PMM_DMA);
+    break;
+  case HUGE:
+    b->pages = PMM_HUGE_SIZE / 4096;
+    align = PMM_HUGE_SIZE;
+    b->phys = pmm_huge_alloc();
+    break;
+  default:
+    break;
+  }
+
+  // Running out is allowed; handing out bad memory is not.
+  if (b->phys)
+    take(b, align);
+}
+
+int main(int argc, char **argv)
+{
+  unsigned long ops = 200000;
+  if (argc > 1)
+    ops = strtoul(argv[1], NULL, 0);
+  if (argc > 2)
+    seed = strtoull(argv[2], NULL, 0) | 1;
+
+  host_boot(MEMORY);
+
+  size_t before = drain_count();
+  unsigned long allocs = 0, exhausted = 0;
+
+  for (unsigned long i = 0; i < ops; i++)
+  {
+    struct block *b = &live[rnd() % LIVE];
+    if (b->phys)
+    {
+      release(b);
+      continue;
+    }
+    allocate(b);
+    allocs++;
+    exhausted += !b->phys;
+  }
+
+  for (unsigned int i = 0; i < LIVE; i++)
+    if (live[i].phys)
+      release(&live[i]);
+
+  // Free one page twice: the second free must be ignored, or the next two
+  // allocations get the same page.
+  uintptr_t twice = pmm_alloc_order(0);
+  pmm_free_order(twice, 0);
+  pmm_free_order(twice, 0);
+  uintptr_t first = pmm_alloc_order(0), second = pmm_alloc_order(0);
+  CHECK(first != second, "page %#lx handed out twice after a double free", (unsigned long)first);
+  pmm_free_order(first, 0);
+  pmm_free_order(second, 0);
+
+  size_t after = drain_count();
+  CHECK(after == before, "%zu pages free after freeing everything, %zu before", after, before);
+  CHECK(pmm_check(), "pmm_check() failed");
+
+  printf("pmm_test ops=%lu allocs=%lu exhausted=%lu pages=%zu failures=%lu\n", ops, allocs, exhausted,
+         before, failures);
+  return failures != 0;
+}
@@ -0,0 +1,73 @@
+/* Cost of growing a buffer with realloc().
+
+   doubling: grow 16 bytes -> 1 MiB by doubling, like a vector.
+   append:   grow 1 KiB at a time up to 256 KiB, like a log or string builder.
+
+   Each pattern runs once with realloc() and once with the old behaviour
+   (malloc a new buffer, copy everything, free the old one) for comparison.
+   "moves" counts the steps where the buffer changed address.
+
+   usage: realloc_grow [rounds] */
+
+#include "host.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void *grow_copy(void *p, size_t old, size_t size)
+{
+  void *q = lb_malloc(size);
+  if (q && p)
+    memcpy(q, p, old < size ? old : size);
+  lb_free(p);
+  return q;
+}
+
+static void run(const char *pattern, int copy, unsigned long rounds, size_t first, size_t last, size_t step)
+{
+  unsigned long steps = 0, moves = 0;
+  uint64_t t0 = host_ns();
+
+  for (unsigned long r = 0; r < rounds; r++)
+  {
+    char *p = NULL;
+    size_t have = 0;
+    for (size_t size = first; size <= last; size = step ? size + step : size * 2)
+    {
+      char *q = copy ? grow_copy(p, have, size) : lb_realloc(p, size);
+      if (!q)
+      {
+        fprintf(stderr, "%s: out of memory at %zu bytes\n", pattern, size);
+        exit(1);
+      }
+      moves += q != p;
+      steps++;
+      memset(q + have, (int)r, size - have);
+      p = q;
+      have = size;
+    }
+    lb_free(p);
+  }
+
+  uint64_t ns = host_ns() - t0;
+  printf("realloc_grow pattern=%s mode=%s steps=%lu moves=%lu ns=%llu ns_per_step=%.1f\n",
+         pattern, copy ? "copy" : "realloc", steps, moves, (unsigned long long)ns, (double)ns / steps);
+}
+
+int main(int argc, char **argv)
+{
+  unsigned long rounds = 2000;
+  if (argc > 1)
+    rounds = strtoul(argv[1], NULL, 0);
+
+  host_boot(256ul << 20);
+
+  run("doubling", 0, rounds, 16, 1ul << 20, 0);
+  run("doubling", 1, rounds, 16, 1ul << 20, 0);
+  run("append", 0, rounds / 10, 1024, 256 * 1024, 1024);
+  run("append", 1, rounds / 10, 1024, 256 * 1024, 1024);
+
+  host_print_heap_stats("realloc_grow");
+  return 0;
+}
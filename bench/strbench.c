@@ -0,0 +1,132 @@
+/* Bytes per cycle of the kernel libc's string routines and the host C
+   library's, over strings of growing length. Each call scans the whole
+   string: searches look for a byte that only appears at the end, and
+   comparisons compare equal strings. Cycles are TSC ticks on x86_64 and
+   nanoseconds elsewhere (reported as bytes_per_ns).
+
+   usage: strbench [bytes_per_point] */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "libc_string.h"
+
+#define MAX_SIZE 65536
+
+static unsigned char a[MAX_SIZE + 64] __attribute__((aligned(64)));
+static unsigned char b[MAX_SIZE + 64] __attribute__((aligned(64)));
+static unsigned char dst[MAX_SIZE + 64] __attribute__((aligned(64)));
+
+static uint64_t ticks(void)
+{
+#if defined(__x86_64__)
+  uint32_t lo, hi;
+  __asm__ __volatile__("rdtsc" : "=a"(lo), "=d"(hi));
+  return ((uint64_t)hi << 32) | lo;
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+#endif
+}
+
+#if defined(__x86_64__)
+#define UNIT "bytes_per_cycle"
+#else
+#define UNIT "bytes_per_ns"
+#endif
+
+enum func
+{
+  F_STRLEN,
+  F_MEMCHR,
+  F_STRCHR,
+  F_STRRCHR,
+  F_STRCMP,
+  F_MEMCMP,
+  F_STRCPY,
+  F_STRNCPY,
+  F_COUNT,
+};
+
+static const char *const names[F_COUNT] = {
+    "strlen", "memchr", "strchr", "strrchr", "strcmp", "memcmp", "strcpy", "strncpy",
+};
+
+static uintptr_t sink;
+
+static void call(enum func f, int libc, const char *s, const char *t, size_t n)
+{
+  switch (f)
+  {
+  case F_STRLEN:
+    sink += libc ? libc_strlen(s) : strlen(s);
+    break;
+  case F_MEMCHR:
+    sink += (uintptr_t)(libc ? libc_memchr(s, 'z', n) : memchr(s, 'z', n));
+    break;
+  case F_STRCHR:
+    sink += (uintptr_t)(libc ? libc_strchr(s, 'z') : strchr(s, 'z'));
+    break;
+  case F_STRRCHR:
+    sink += (uintptr_t)(libc ? libc_strrchr(s, 'a') : strrchr(s, 'a'));
+    break;
+  case F_STRCMP:
+    sink += libc ? libc_strcmp(s, t) : strcmp(s, t);
+    break;
+  case F_MEMCMP:
+    sink += libc ? libc_memcmp(s, t, n) : memcmp(s, t, n);
+    break;
+  case F_STRCPY:
+    sink += (uintptr_t)(libc ? libc_strcpy((char *)dst, s) : strcpy((char *)dst, s));
+    break;
+  case F_STRNCPY:
+    sink += (uintptr_t)(libc ? libc_strncpy((char *)dst, s, n + 1) : strncpy((char *)dst, s, n + 1));
+    break;
+  default:
+    break;
+  }
+  __asm__ __volatile__("" ::: "memory");
+}
+
+int main(int argc, char **argv)
+{
+  unsigned long bytes_per_point = 64ul << 20;
+  if (argc > 1)
+    bytes_per_point = strtoul(argv[1], NULL, 0);
+
+  static const size_t sizes[] = {8, 16, 32, 64, 256, 1024, 4096, MAX_SIZE};
+
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+  {
+    size_t n = sizes[i];
+    // `b` starts 3 bytes in so the comparisons see misaligned pairs too.
+    for (unsigned int misalign = 0; misalign <= 3; misalign += 3)
+    {
+      char *s = (char *)a;
+      char *t = (char *)b + misalign;
+      memset(s, 'y', n);
+      s[n - 1] = 'z';
+      s[n] = 0;
+      memcpy(t, s, n + 1);
+
+      unsigned long reps = bytes_per_point / n;
+      for (int f = 0; f < F_COUNT; f++)
+      {
+        for (int libc = 1; libc >= 0; libc--)
+        {
+          uint64_t t0 = ticks();
+          for (unsigned long r = 0; r < reps; r++)
+            call((enum func)f, libc, s, t, n);
+          uint64_t dt = ticks() - t0;
+          printf("strbench func=%s impl=%s size=%zu misalign=%u " UNIT "=%.3f\n",
+                 names[f], libc ? "libc" : "host", n, misalign, (double)n * reps / dt);
+        }
+      }
+    }
+  }
+  return sink == 0x5a5a5a5a ? 1 : 0;
+}
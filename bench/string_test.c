@@ -0,0 +1,317 @@
+/* Checks the kernel libc's string routines against the host C library.
+
+   Every case puts its buffers right against an inaccessible page, either
+   ending at it or starting after it, at every alignment, so a routine that
+   reads past either end of its input faults instead of passing by luck.
+   Contents are random bytes with the searched-for and terminating bytes
+   sprinkled in, over lengths that cover the byte heads and tails as well as
+   the word loops. One line per routine; exits non-zero on any mismatch.
+
+   usage: string_test [rounds] [seed] */
+
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "libc_string.h"
+
+#define MAX_LEN 600
+
+static uint64_t seed = 0x243f6a8885a308d3ull;
+static unsigned char *low_end;    // first byte of a guard page
+static unsigned char *high_start; // first byte after a guard page
+static unsigned long failures;
+static const char *testing = "setup";
+
+/* A read past a buffer hits a guard page; say which routine did it. */
+static void on_fault(int sig)
+{
+  (void)sig;
+  static const char msg[] = "string_test FAIL fault in ";
+  write(1, msg, sizeof(msg) - 1);
+  write(1, testing, strlen(testing));
+  write(1, "\n", 1);
+  _exit(2);
+}
+
+static uint64_t rnd(void)
+{
+  seed ^= seed << 13;
+  seed ^= seed >> 7;
+  seed ^= seed << 17;
+  return seed;
+}
+
+/* Length: mostly short, sometimes long enough for many words. */
+static size_t rnd_len(void)
+{
+  uint64_t r = rnd();
+  return (r & 3) ? (r >> 8) % 40 : (r >> 8) % MAX_LEN;
+}
+
+/* A buffer of `size` bytes, ending at the low guard or starting at the high
+   one, at a random alignment. */
+static unsigned char *place(size_t size, int at_end)
+{
+  size_t slack = rnd() % 16;
+  if (at_end)
+    return low_end - size - slack * (rnd() & 1);
+  return high_start + slack;
+}
+
+/* Random non-zero bytes, some of them `c`. */
+static void fill(unsigned char *p, size_t n, unsigned char c)
+{
+  unsigned int density = 1 + rnd() % 64;
+  for (size_t i = 0; i < n; i++)
+  {
+    unsigned char b = (unsigned char)(1 + rnd() % 255);
+    if (c && rnd() % density == 0)
+      b = c;
+    p[i] = b;
+  }
+}
+
+static int sign(long v)
+{
+  return (v > 0) - (v < 0);
+}
+
+#define CHECK(cond, ...)                  \
+  do                                      \
+  {                                       \
+    if (!(cond))                          \
+    {                                     \
+      if (failures++ < 20)                \
+      {                                   \
+        printf("string_test FAIL ");      \
+        printf(__VA_ARGS__);              \
+        printf("\n");                     \
+      }                                   \
+      bad++;                              \
+    }                                     \
+  } while (0)
+
+static void report(const char *name, unsigned long cases, unsigned long bad)
+{
+  printf("string_test func=%s cases=%lu failures=%lu\n", name, cases, bad);
+}
+
+static void test_strlen(unsigned long rounds)
+{
+  testing = "strlen";
+  unsigned long bad = 0;
+  for (unsigned long i = 0; i < rounds; i++)
+  {
+    size_t n = rnd_len();
+    unsigned char *s = place(n + 1, i & 1);
+    fill(s, n, 0);
+    s[n] = 0;
+    CHECK(libc_strlen((char *)s) == n, "strlen len=%zu align=%lu", n, (unsigned long)((uintptr_t)s & 7));
+
+    size_t max = rnd() % (n + 8);
+    unsigned char *t = place(max > n ? n + 1 : max, i & 1);
+    memmove(t, s, max > n ? n + 1 : max);
+    CHECK(libc_strnlen((char *)t, max) == strnlen((char *)t, max), "strnlen len=%zu max=%zu", n, max);
+  }
+  report("strlen", rounds, bad);
+}
+
+static void test_memchr(unsigned long rounds)
+{
+  testing = "memchr";
+  unsigned long bad = 0;
+  for (unsigned long i = 0; i < rounds; i++)
+  {
+    size_t n = rnd_len();
+    unsigned char c = (unsigned char)rnd();
+    unsigned char *s = place(n, i & 1);
+    fill(s, n, c);
+    if (rnd() & 1)
+      c = (unsigned char)rnd(); // often absent
+    int arg = (rnd() & 1) ? c : c | 0x100; // only the low byte counts
+    CHECK(libc_memchr(s, arg, n) == memchr(s, arg, n), "memchr len=%zu c=%#x", n, arg);
+  }
+  report("memchr", rounds, bad);
+}
+
+static void test_strchr(unsigned long rounds)
+{
+  testing = "strchr";
+  unsigned long bad = 0;
+  for (unsigned long i = 0; i < rounds; i++)
+  {
+    size_t n = rnd_len();
+    unsigned char c = (unsigned char)rnd();
+    unsigned char *s = place(n + 1, i & 1);
+    fill(s, n, c);
+    s[n] = 0;
+    if ((rnd() & 3) == 0)
+      c = (unsigned char)rnd();
+    if ((rnd() & 15) == 0)
+      c = 0;
+    CHECK(libc_strchr((char *)s, c) == strchr((char *)s, c), "strchr len=%zu c=%#x", n, c);
+    CHECK(libc_strrchr((char *)s, c) == strrchr((char *)s, c), "strrchr len=%zu c=%#x", n, c);
+  }
+  report("strchr", rounds, bad);
+}
+
+static void test_strcmp(unsigned long rounds)
+{
+  testing = "strcmp";
+  unsigned long bad = 0;
+  for (unsigned long i = 0; i < rounds; i++)
+  {
+    size_t n = rnd_len();
+    unsigned char *a = place(n + 1, i & 1);
+    fill(a, n, 0);
+    a[n] = 0;
+
+    // b: a copy, possibly shorter, longer or differing at one byte.
+    size_t m = n;
+    switch (rnd() % 4)
+    {
+    case 0:
+      m = n ? rnd() % n : 0;
+      break;
+    case 1:
+      m = n + rnd() % 16;
+      break;
+    }
+    unsigned char *b = place(m + 1, !(i & 2));
+    memcpy(b, a, m < n ? m : n);
+    fill(b + n, m > n ? m - n : 0, 0);
+    b[m] = 0;
+    if (m && (rnd() & 1))
+      b[rnd() % m] = (unsigned char)(1 + rnd() % 255);
+
+    CHECK(sign(libc_strcmp((char *)a, (char *)b)) == sign(strcmp((char *)a, (char *)b)),
+          "strcmp len=%zu/%zu align=%lu/%lu", n, m, (unsigned long)((uintptr_t)a & 7), (unsigned long)((uintptr_t)b & 7));
+    size_t k = rnd() % (n + 16);
+    CHECK(sign(libc_strncmp((char *)a, (char *)b, k)) == sign(strncmp((char *)a, (char *)b, k)),
+          "strncmp len=%zu/%zu n=%zu", n, m, k);
+  }
+  report("strcmp", rounds, bad);
+}
+
+/* memcmp, unlike strcmp, does not stop at zero bytes. */
+static void test_memcmp(unsigned long rounds)
+{
+  testing = "memcmp";
+  unsigned long bad = 0;
+  for (unsigned long i = 0; i < rounds; i++)
+  {
+    size_t n = rnd_len();
+    unsigned char *a = place(n, i & 1);
+    unsigned char *b = place(n, !(i & 2));
+    for (size_t k = 0; k < n; k++)
+      a[k] = (unsigned char)(rnd() % 4 == 0 ? 0 : rnd());
+    memmove(b, a, n);
+    if (n && (rnd() & 1))
+      b[rnd() % n] = (unsigned char)rnd();
+    CHECK(sign(libc_memcmp(a, b, n)) == sign(memcmp(a, b, n)), "memcmp len=%zu", n);
+  }
+  report("memcmp", rounds, bad);
+}
+
+static void test_strcpy(unsigned long rounds)
+{
+  testing = "strcpy";
+  static unsigned char want[MAX_LEN + 64], got[MAX_LEN + 64];
+  unsigned long bad = 0;
+  for (unsigned long i = 0; i < rounds; i++)
+  {
+    size_t n = rnd_len();
+    unsigned char *s = place(n + 1, i & 1);
+    fill(s, n, 0);
+    s[n] = 0;
+
+    // Copy into a canary-filled buffer so stray writes show.
+    size_t off = rnd() % 16;
+    memset(want, 0xa5, sizeof(want));
+    memset(got, 0xa5, sizeof(got));
+    strcpy((char *)want + off, (char *)s);
+    char *r = libc_strcpy((char *)got + off, (char *)s);
+    CHECK(r == (char *)got + off && memcmp(want, got, sizeof(got)) == 0, "strcpy len=%zu off=%zu", n, off);
+
+    size_t k = rnd() % (n + 24);
+    memset(want, 0xa5, sizeof(want));
+    memset(got, 0xa5, sizeof(got));
+    unsigned char *src = place(k < n + 1 ? k : n + 1, i & 2);
+    memmove(src, s, k < n + 1 ? k : n + 1);
+    strncpy((char *)want + off, (char *)src, k);
+    r = libc_strncpy((char *)got + off, (char *)src, k);
+    CHECK(r == (char *)got + off && memcmp(want, got, sizeof(got)) == 0, "strncpy len=%zu n=%zu off=%zu", n, k, off);
+  }
+  report("strcpy", rounds, bad);
+}
+
+static void test_mem(unsigned long rounds)
+{
+  testing = "mem";
+  static unsigned char want[2 * MAX_LEN + 64], got[2 * MAX_LEN + 64];
+  unsigned long bad = 0;
+  for (unsigned long i = 0; i < rounds; i++)
+  {
+    size_t n = rnd_len();
+    size_t d = rnd() % (MAX_LEN + 32), s = rnd() % (MAX_LEN + 32);
+    for (size_t k = 0; k < sizeof(want); k++)
+      want[k] = got[k] = (unsigned char)rnd();
+
+    memmove(want + d, want + s, n);
+    libc_memmove(got + d, got + s, n);
+    CHECK(memcmp(want, got, sizeof(got)) == 0, "memmove len=%zu dest=%zu src=%zu", n, d, s);
+
+    unsigned char *src = place(n, i & 1);
+    fill(src, n, 0);
+    memcpy(want + d, src, n);
+    libc_memcpy(got + d, src, n);
+    CHECK(memcmp(want, got, sizeof(got)) == 0, "memcpy len=%zu dest=%zu", n, d);
+
+    int c = (int)rnd();
+    memset(want + d, c, n);
+    libc_memset(got + d, c, n);
+    CHECK(memcmp(want, got, sizeof(got)) == 0, "memset len=%zu dest=%zu", n, d);
+  }
+  report("mem", rounds, bad);
+}
+
+int main(int argc, char **argv)
+{
+  unsigned long rounds = 200000;
+  if (argc > 1)
+    rounds = strtoul(argv[1], NULL, 0);
+  if (argc > 2)
+    seed = strtoull(argv[2], NULL, 0) | 1;
+
+  // [data][guard][guard][data]: the low data page ends at a guard, the high
+  // one starts after one.
+  size_t page = (size_t)sysconf(_SC_PAGESIZE);
+  size_t data = ((MAX_LEN + 64 + page - 1) / page) * page;
+  unsigned char *map = mmap(NULL, 2 * data + 2 * page, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (map == MAP_FAILED)
+  {
+    perror("mmap");
+    return 1;
+  }
+  mprotect(map + data, 2 * page, PROT_NONE);
+  signal(SIGSEGV, on_fault);
+  setvbuf(stdout, NULL, _IOLBF, 0);
+  low_end = map + data;
+  high_start = map + data + 2 * page;
+
+  test_strlen(rounds);
+  test_memchr(rounds);
+  test_strchr(rounds);
+  test_strcmp(rounds);
+  test_memcmp(rounds);
+  test_strcpy(rounds);
+  test_mem(rounds / 4);
+
+  printf("string_test failures=%lu\n", failures);
+  return failures != 0;
+}
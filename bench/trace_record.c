@@ -0,0 +1,105 @@
+/* Records an allocation trace of a synthetic kernel-like workload, for
+   trying trace_replay without a machine to capture one on.
+
+   A window of live objects is churned with mostly small allocations, some
+   buffers grown with realloc, a few aligned and large ones, and now and
+   then a burst that allocates many objects and frees most of them, leaving
+   survivors scattered through the heap. The trace is written to stdout in
+   the same text form the kernel dumps over serial.
+
+   usage: trace_record [ops] > trace */
+
+#include "host.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+
+#include <kernel/alloctrace/alloctrace.h>
+#include <kernel/liballoc/liballoc.h>
+
+#define WINDOW 4096
+#define RING_BYTES (64ul << 20)
+
+static uint64_t seed = 0x452821e638d01377ull;
+
+static uint64_t xorshift(void)
+{
+  seed ^= seed << 13;
+  seed ^= seed >> 7;
+  seed ^= seed << 17;
+  return seed;
+}
+
+static size_t pick_size(void)
+{
+  uint64_t r = xorshift();
+  if ((r & 7) != 0)
+    return 8 + (r >> 8) % 121;
+  if ((r & 63) != 0)
+    return 129 + (r >> 8) % 4000;
+  return 4096 + (r >> 8) % (512 * 1024);
+}
+
+static void write_out(const char *buf, size_t len)
+{
+  fwrite(buf, 1, len, stdout);
+}
+
+int main(int argc, char **argv)
+{
+  unsigned long ops = 500000;
+  if (argc > 1)
+    ops = strtoul(argv[1], NULL, 0);
+
+  host_boot(512ul << 20);
+
+  void *ring = mmap(NULL, RING_BYTES, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (ring == MAP_FAILED)
+    return 1;
+  alloctrace_start(ring, RING_BYTES);
+
+  static void *live[WINDOW];
+  static size_t sizes[WINDOW];
+  for (unsigned long i = 0; i < ops; i++)
+  {
+    unsigned int slot = xorshift() % WINDOW;
+
+    if (i % 50000 == 0)
+    {
+      // Burst: fill the whole window, then free nine in ten.
+      for (unsigned int s = 0; s < WINDOW; s++)
+        if (!live[s])
+          live[s] = lb_malloc(sizes[s] = pick_size());
+      for (unsigned int s = 0; s < WINDOW; s++)
+        if (xorshift() % 10)
+        {
+          lb_free(live[s]);
+          live[s] = NULL;
+        }
+      continue;
+    }
+
+    if (live[slot] && sizes[slot] < 64 * 1024 && xorshift() % 8 == 0)
+    {
+      sizes[slot] += sizes[slot] / 2 + 16;
+      void *p = lb_realloc(live[slot], sizes[slot]);
+      if (p)
+        live[slot] = p;
+      continue;
+    }
+
+    lb_free(live[slot]);
+    live[slot] = NULL;
+    if (xorshift() % 32 == 0)
+      live[slot] = kmalloc_aligned(sizes[slot] = pick_size(), 64ul << xorshift() % 7);
+    else if (xorshift() % 16 == 0)
+      live[slot] = lb_calloc(1, sizes[slot] = pick_size());
+    else
+      live[slot] = lb_malloc(sizes[slot] = pick_size());
+  }
+  // The window stays allocated, so the replay ends with a heap in use.
+  alloctrace_stop();
+  alloctrace_dump(write_out);
+  return 0;
+}
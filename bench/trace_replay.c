@@ -0,0 +1,404 @@
+/* Replays an allocation trace against liballoc and the host C library.
+
+   The trace is the text alloctrace_dump() writes; it may sit inside a
+   longer serial log, anything outside the begin/end markers is skipped.
+   Every allocator gets the same calls in the same order, with object ids
+   mapped to whatever pointers it hands out. Per allocator:
+
+     ns, ns_per_op  wall time for the calls, bookkeeping excluded
+     peak_live      most bytes the trace had live at once
+     peak_rss       most memory the allocator held from the system, sampled
+                    every SAMPLE_EVERY events: PMM pages for liballoc,
+                    mallinfo2() arena plus mmapped bytes for the C library
+     rss_ratio      peak_rss / peak_live
+     end_frag       1 - live / held, just before the remaining objects are
+                    freed; retained is what it still holds after that
+
+   Events lost to a wrapped ring show up as frees and reallocs of unknown
+   objects; those frees are skipped and the reallocs become mallocs.
+
+   usage: trace_replay trace [liballoc|libc ...] */
+
+#include "host.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+#include <kernel/alloctrace/alloctrace.h>
+#include <kernel/liballoc/liballoc.h>
+
+#define SAMPLE_EVERY 256
+
+struct allocator
+{
+  const char *name;
+  void *(*malloc)(size_t size);
+  void *(*calloc)(size_t nobj, size_t size);
+  void *(*realloc)(void *ptr, size_t size);
+  void *(*aligned)(size_t size, size_t align);
+  void (*free)(void *ptr);
+  size_t (*held)(void);
+};
+
+static size_t liballoc_held(void)
+{
+  struct heap_stats st;
+  heap_stats(&st);
+  return st.bytes_reserved + st.slab_bytes_reserved;
+}
+
+static void *libc_aligned(size_t size, size_t align)
+{
+  void *ptr;
+  if (align < sizeof(void *))
+    align = sizeof(void *);
+  return posix_memalign(&ptr, align, size) ? NULL : ptr;
+}
+
+static size_t libc_held(void)
+{
+#if defined(__GLIBC__)
+  struct mallinfo2 mi = mallinfo2();
+  return mi.arena + mi.hblkhd;
+#else
+  return 0;
+#endif
+}
+
+static const struct allocator allocators[] = {
+    {"liballoc", lb_malloc, lb_calloc, lb_realloc, kmalloc_aligned, lb_free, liballoc_held},
+    {"libc", malloc, calloc, realloc, libc_aligned, free, libc_held},
+};
+
+static struct alloctrace_event *events;
+static size_t nevents, dropped, bad_lines;
+
+static int hex_digit(char c)
+{
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  if (c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  return -1;
+}
+
+static int parse_event(const char *line, struct alloctrace_event *ev)
+{
+  unsigned char *bytes = (unsigned char *)ev;
+  for (size_t b = 0; b < sizeof(*ev); b++)
+  {
+    int hi = hex_digit(line[2 * b]), lo = hi < 0 ? -1 : hex_digit(line[2 * b + 1]);
+    if (lo < 0)
+      return 0;
+    bytes[b] = (unsigned char)(hi << 4 | lo);
+  }
+  return line[2 * sizeof(*ev)] == '\n' || line[2 * sizeof(*ev)] == '\r' || line[2 * sizeof(*ev)] == 0;
+}
+
+/* Every dump in the file, one after the other. */
+static int load(const char *path)
+{
+  FILE *f = fopen(path, "r");
+  if (!f)
+  {
+    perror(path);
+    return 0;
+  }
+
+  char line[256];
+  size_t cap = 0;
+  int inside = 0, dumps = 0;
+  while (fgets(line, sizeof(line), f))
+  {
+    const char *mark = strstr(line, "alloctrace ");
+    if (mark && strncmp(mark, "alloctrace begin", 16) == 0)
+    {
+      unsigned int version = 0, event_size = 0;
+      unsigned long lost = 0;
+      const char *v = strstr(mark, "version="), *s = strstr(mark, "event_size="), *d = strstr(mark, "dropped=");
+      if (v)
+        version = strtoul(v + 8, NULL, 10);
+      if (s)
+        event_size = strtoul(s + 11, NULL, 10);
+      if (d)
+        lost = strtoul(d + 8, NULL, 10);
+      if (version != ALLOCTRACE_VERSION || event_size != sizeof(struct alloctrace_event))
+      {
+        fprintf(stderr, "%s: unsupported trace version=%u event_size=%u\n", path, version, event_size);
+        fclose(f);
+        return 0;
+      }
+      dropped += lost;
+      inside = 1;
+      dumps++;
+      continue;
+    }
+    if (!inside)
+      continue;
+    if (mark && strncmp(mark, "alloctrace end", 14) == 0)
+    {
+      inside = 0;
+      continue;
+    }
+
+    if (nevents == cap)
+    {
+      cap = cap ? cap * 2 : 65536;
+      events = realloc(events, cap * sizeof(*events));
+      if (!events)
+      {
+        fprintf(stderr, "%s: out of memory\n", path);
+        exit(1);
+      }
+    }
+    if (parse_event(line, &events[nevents]))
+      nevents++;
+    else
+      bad_lines++;
+  }
+  fclose(f);
+
+  if (!dumps)
+    fprintf(stderr, "%s: no alloctrace dump found\n", path);
+  return dumps != 0;
+}
+
+/* Live objects: open addressing on the trace's object id. */
+struct object
+{
+  uint32_t id; // 0: empty
+  void *ptr;
+  size_t size;
+};
+
+static struct object *objects;
+static size_t objects_mask;
+
+static struct object *lookup(uint32_t id)
+{
+  size_t i = (id * 0x9e3779b1u) & objects_mask;
+  while (objects[i].id && objects[i].id != id)
+    i = (i + 1) & objects_mask;
+  return &objects[i];
+}
+
+/* Backward-shift deletion keeps probe chains intact without tombstones. */
+static void remove_object(struct object *o)
+{
+  size_t hole = o - objects;
+  size_t i = hole;
+  for (;;)
+  {
+    i = (i + 1) & objects_mask;
+    if (!objects[i].id)
+      break;
+    size_t home = (objects[i].id * 0x9e3779b1u) & objects_mask;
+    // Move the entry back if its home is not in (hole, i].
+    if (((i - home) & objects_mask) >= ((i - hole) & objects_mask))
+    {
+      objects[hole] = objects[i];
+      hole = i;
+    }
+  }
+  objects[hole].id = 0;
+}
+
+struct replay_stats
+{
+  size_t live, peak_live, peak_held;
+  unsigned long unknown_frees, unknown_reallocs, stale, failed;
+};
+
+static void sample(const struct allocator *a, struct replay_stats *st)
+{
+  size_t held = a->held();
+  if (held > st->peak_held)
+    st->peak_held = held;
+}
+
+static void replay_event(const struct allocator *a, const struct alloctrace_event *ev, struct replay_stats *st)
+{
+  struct object *o, *old = NULL;
+  void *ptr;
+
+  if (ev->op == ALLOCTRACE_FREE)
+  {
+    o = lookup(ev->id);
+    if (!o->id)
+    {
+      st->unknown_frees++;
+      return;
+    }
+    a->free(o->ptr);
+    st->live -= o->size;
+    remove_object(o);
+    return;
+  }
+
+  if (ev->op == ALLOCTRACE_REALLOC && ev->old_id)
+  {
+    old = lookup(ev->old_id);
+    if (!old->id)
+    {
+      st->unknown_reallocs++;
+      old = NULL;
+    }
+  }
+  // Failed in the kernel, so nothing changed there either; or realloc(NULL, 0).
+  if ((!ev->id && ev->size) || (ev->op == ALLOCTRACE_REALLOC && !ev->size && !old))
+    return;
+
+  // The free of an object whose id is being reused was lost.
+  if (ev->id && (!old || ev->id != ev->old_id))
+  {
+    o = lookup(ev->id);
+    if (o->id)
+    {
+      st->stale++;
+      a->free(o->ptr);
+      st->live -= o->size;
+      remove_object(o);
+      if (old)
+        old = lookup(ev->old_id);
+    }
+  }
+
+  switch (ev->op)
+  {
+  case ALLOCTRACE_CALLOC:
+    ptr = a->calloc(1, ev->size);
+    break;
+  case ALLOCTRACE_ALIGNED:
+    ptr = a->aligned(ev->size, (size_t)1 << ev->align_log2);
+    break;
+  case ALLOCTRACE_REALLOC:
+    ptr = a->realloc(old ? old->ptr : NULL, ev->size);
+    if (old && (ptr || !ev->size))
+    {
+      st->live -= old->size;
+      remove_object(old);
+    }
+    break;
+  default:
+    ptr = a->malloc(ev->size);
+  }
+
+  if (!ev->id)
+    return;
+  if (!ptr)
+  {
+    st->failed++;
+    return;
+  }
+
+  o = lookup(ev->id);
+  o->id = ev->id;
+  o->ptr = ptr;
+  o->size = ev->size;
+  st->live += ev->size;
+  if (st->live > st->peak_live)
+    st->peak_live = st->live;
+}
+
+static size_t since(size_t base, size_t now)
+{
+  return now > base ? now - base : 0;
+}
+
+static void replay(const char *path, const struct allocator *a)
+{
+  struct replay_stats st = {0};
+  size_t base = a->held();
+  uint64_t sampling = 0;
+
+  uint64_t t0 = host_ns();
+  for (size_t i = 0; i < nevents; i++)
+  {
+    replay_event(a, &events[i], &st);
+    if (i % SAMPLE_EVERY == 0)
+    {
+      uint64_t s0 = host_ns();
+      sample(a, &st);
+      sampling += host_ns() - s0;
+    }
+  }
+  uint64_t ns = host_ns() - t0 - sampling;
+  sample(a, &st);
+
+  size_t end_live = st.live, end_held = since(base, a->held());
+  for (size_t i = 0; i <= objects_mask; i++)
+  {
+    if (objects[i].id)
+      a->free(objects[i].ptr);
+    objects[i].id = 0;
+  }
+  size_t retained = since(base, a->held());
+  size_t peak_rss = since(base, st.peak_held);
+
+  printf("trace_replay trace=%s allocator=%s ns=%llu ns_per_op=%.1f peak_live=%zu peak_rss=%zu"
+         " rss_ratio=%.3f end_live=%zu end_rss=%zu end_frag=%.3f retained=%zu failed=%lu\n",
+         path, a->name, (unsigned long long)ns, nevents ? (double)ns / nevents : 0.0, st.peak_live,
+         peak_rss, st.peak_live ? (double)peak_rss / st.peak_live : 0.0, end_live, end_held,
+         end_held ? 1.0 - (double)end_live / end_held : 0.0, retained, st.failed);
+  printf("trace_replay trace=%s allocator=%s unknown_frees=%lu unknown_reallocs=%lu stale=%lu\n", path,
+         a->name, st.unknown_frees, st.unknown_reallocs, st.stale);
+}
+
+/* What the kernel measured while recording: calls and mean cycles per op. */
+static void print_trace(const char *path)
+{
+  static const char *names[] = {"?", "malloc", "calloc", "realloc", "aligned", "free"};
+  unsigned long count[6] = {0};
+  uint64_t cycles[6] = {0};
+
+  for (size_t i = 0; i < nevents; i++)
+  {
+    unsigned int op = events[i].op < 6 ? events[i].op : 0;
+    count[op]++;
+    cycles[op] += events[i].cycles;
+  }
+
+  printf("trace_replay trace=%s events=%zu dropped=%zu bad_lines=%zu\n", path, nevents, dropped, bad_lines);
+  for (unsigned int op = 1; op < 6; op++)
+    if (count[op])
+      printf("trace_replay trace=%s op=%s count=%lu traced_cycles=%.1f\n", path, names[op], count[op],
+             (double)cycles[op] / count[op]);
+}
+
+int main(int argc, char **argv)
+{
+  if (argc < 2)
+  {
+    fprintf(stderr, "usage: trace_replay trace [liballoc|libc ...]\n");
+    return 2;
+  }
+  if (!load(argv[1]))
+    return 1;
+  print_trace(argv[1]);
+
+  // Never more live objects than events.
+  size_t slots = 2;
+  while (slots < 2 * nevents)
+    slots *= 2;
+  objects = calloc(slots, sizeof(*objects));
+  objects_mask = slots - 1;
+  if (!objects)
+    return 1;
+
+  for (size_t i = 0; i < sizeof(allocators) / sizeof(allocators[0]); i++)
+  {
+    int wanted = argc < 3;
+    for (int j = 2; j < argc; j++)
+      wanted |= strcmp(argv[j], allocators[i].name) == 0;
+    if (!wanted)
+      continue;
+    if (strcmp(allocators[i].name, "liballoc") == 0)
+      host_boot(1ul << 30);
+    replay(argv[1], &allocators[i]);
+  }
+  return 0;
+}
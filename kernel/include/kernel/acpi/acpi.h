@@ -0,0 +1,25 @@
+#ifndef _H_ACPI
+#define _H_ACPI 1
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Common header of every ACPI system description table. */
+struct acpi_sdt_header
+{
+  char signature[4];
+  uint32_t length; // whole table, header included
+  uint8_t revision;
+  uint8_t checksum;
+  char oem_id[6];
+  char oem_table_id[8];
+  uint32_t oem_revision;
+  uint32_t creator_id;
+  uint32_t creator_revision;
+} __attribute__((packed));
+
+/* Find the table with the given 4-character signature (e.g. "SRAT") through
+   the RSDP the bootloader handed us. Returns NULL if there is none. */
+struct acpi_sdt_header *acpi_find_table(const char *signature);
+
+#endif
@@ -0,0 +1,86 @@
+#ifndef _H_ALLOCTRACE
+#define _H_ALLOCTRACE 1
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include <kernel/cpu/cpu.h>
+
+/* Allocation trace: every malloc()/calloc()/realloc()/kmalloc_aligned()/
+   free() that goes through liballoc, recorded into a RAM ring while tracing
+   is on, so a real workload can be replayed against the allocator on the
+   host (bench/trace_replay). */
+
+#define ALLOCTRACE_MALLOC 1
+#define ALLOCTRACE_CALLOC 2
+#define ALLOCTRACE_REALLOC 3
+#define ALLOCTRACE_ALIGNED 4 // kmalloc_aligned(), aligned_alloc(), posix_memalign()
+#define ALLOCTRACE_FREE 5
+
+/* Timestamps are cpu_timestamp() shifted right by this much, so 32 bits
+   last minutes before wrapping. */
+#define ALLOCTRACE_TIME_SHIFT 8
+
+#define ALLOCTRACE_VERSION 1
+
+/* Objects are named by their address divided by 16 (the heap's minimum
+   alignment), truncated to 32 bits: unique among live objects as long as
+   the heap spans less than 64 GiB of address space. 0 means NULL. */
+static inline uint32_t alloctrace_id(const void *ptr)
+{
+  return (uint32_t)((uintptr_t)ptr >> 4);
+}
+
+struct alloctrace_event
+{
+  uint32_t time;      // cpu_timestamp() >> ALLOCTRACE_TIME_SHIFT at entry
+  uint32_t cycles;    // cpu_timestamp() ticks the call took, saturated
+  uint32_t size;      // bytes asked for (0 for free), saturated
+  uint32_t id;        // object returned, or freed
+  uint32_t old_id;    // realloc: object passed in
+  uint8_t op;         // ALLOCTRACE_*
+  uint8_t cpu;
+  uint8_t align_log2; // ALLOCTRACE_ALIGNED: log2 of the alignment
+  uint8_t reserved;
+};
+
+/* Start recording into `bytes` of memory at `buf`, which must not come from
+   the heap being traced. Earlier events are overwritten once it is full. */
+void alloctrace_start(void *buf, size_t bytes);
+
+/* Stop recording; the ring keeps its contents for alloctrace_dump(). */
+void alloctrace_stop(void);
+
+/* Events recorded since alloctrace_start(), including overwritten ones. */
+uint64_t alloctrace_count(void);
+
+/* Write the ring out as text through `write`, oldest event first:
+
+     alloctrace begin version=1 events=N dropped=D time_shift=8 event_size=24
+     <one event per line, its bytes in memory order as hex>
+     alloctrace end
+
+   so it survives a serial console and can be cut out of a boot log. Stop
+   tracing first. */
+void alloctrace_dump(void (*write)(const char *buf, size_t len));
+
+/* Recording hooks for the allocator. */
+extern bool alloctrace_on;
+
+void alloctrace_record(unsigned int op, uint64_t start, size_t size, const void *ptr, const void *old,
+                       size_t align);
+
+static inline uint64_t alloctrace_begin(void)
+{
+  return __builtin_expect(alloctrace_on, 0) ? cpu_timestamp() : 0;
+}
+
+static inline void alloctrace_end(unsigned int op, uint64_t start, size_t size, const void *ptr,
+                                  const void *old, size_t align)
+{
+  if (__builtin_expect(alloctrace_on, 0))
+    alloctrace_record(op, start, size, ptr, old, align);
+}
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef _H_CONSOLE
+#define _H_CONSOLE 1
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/* Text console on the framebuffer: a grid of character cells with a
+   cursor. Writes only update the grid and remember which cells changed;
+   console_flush() draws those cells into the fb back buffer and flushes
+   the scanlines they cover, so a burst of output costs one pass over what
+   it touched instead of a glyph draw per character. */
+
+#define CONSOLE_TAB 8
+
+/* Colours are indices into a 16-entry VGA-style palette. An attribute is
+   foreground | background << 4. */
+#define CONSOLE_ATTR(fg, bg) ((uint8_t)((fg) | (bg) << 4))
+#define CONSOLE_DEFAULT_ATTR CONSOLE_ATTR(7, 0)
+
+/* Take over the screen set up by fb_init(), cleared. Needs the heap for
+   the cell grid; until it succeeds every other call does nothing. */
+bool console_init(void);
+
+/* Put `len` bytes at the cursor. Handles '\n', '\r', '\t' and '\b', wraps
+   at the right edge and scrolls at the bottom. */
+void console_write(const char *buf, size_t len);
+
+/* Draw every cell changed since the last flush. */
+void console_flush(void);
+
+/* console_flush(), unless the last one was less than CONSOLE_FLUSH_TICKS
+   cpu_timestamp() ticks ago. A flood of output then costs a few screen
+   repaints a second instead of one per line; whatever is left over gets
+   drawn by the next console_flush(), which the idle loop makes. */
+#define CONSOLE_FLUSH_TICKS (1ull << 24)
+
+void console_flush_soon(void);
+
+/* Attribute for text written from now on. */
+void console_set_attr(uint8_t attr);
+
+/* Grid size in cells; 0 before console_init(). */
+unsigned int console_cols(void);
+unsigned int console_rows(void);
+
+#endif
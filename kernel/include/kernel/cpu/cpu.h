@@ -0,0 +1,137 @@
+#ifndef _H_CPU
+#define _H_CPU 1
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define MAX_CPUS 64
+#define CACHE_LINE_SIZE 64
+
+/* Give per-CPU data its own cache line so CPUs never false-share it. */
+#define __cacheline_aligned __attribute__((aligned(CACHE_LINE_SIZE)))
+
+/* Per-CPU block. Each CPU finds its own through a register set up once at
+   boot: the GS base on x86_64, TPIDR_EL1 on aarch64, tp on riscv64 and
+   loongarch64. Blocks are cache-line aligned so CPUs never false-share
+   them. Fields are written only by their CPU once it is up. */
+struct cpu_local
+{
+  struct cpu_local *self; // first, so x86_64 loads this_cpu() with one %gs read
+  unsigned int id;        // dense index: 0 is the BSP, APs follow
+  unsigned int node;      // NUMA node
+  uint64_t hw_id;         // local APIC id on x86_64, MPIDR elsewhere
+  void *stack_top;        // NULL on the BSP, which keeps the boot stack
+} __cacheline_aligned;
+
+/* Block of the CPU we are running on. Nothing migrates between CPUs yet,
+   so the compiler is free to keep the result around. */
+static inline struct cpu_local *this_cpu(void)
+{
+  struct cpu_local *c;
+#if defined(__x86_64__)
+  __asm__("movq %%gs:0, %0" : "=r"(c));
+#elif defined(__aarch64__)
+  __asm__("mrs %0, tpidr_el1" : "=r"(c));
+#elif defined(__riscv)
+  __asm__("mv %0, tp" : "=r"(c));
+#elif defined(__loongarch64)
+  __asm__("move %0, $tp" : "=r"(c));
+#endif
+  return c;
+}
+
+/* Index of the CPU we are running on, < MAX_CPUS: what per-CPU arrays are
+   indexed by. One instruction on x86_64. */
+static inline unsigned int cpu_id(void)
+{
+#if defined(__x86_64__)
+  unsigned int id;
+  __asm__("movl %%gs:%c1, %0" : "=r"(id) : "i"(offsetof(struct cpu_local, id)));
+  return id;
+#else
+  return this_cpu()->id;
+#endif
+}
+
+/* Make `c` this CPU's block. Done first thing on every CPU, before
+   anything calls cpu_id(). */
+static inline void cpu_local_install(struct cpu_local *c)
+{
+  c->self = c;
+#if defined(__x86_64__)
+  uint64_t base = (uintptr_t)c;
+  __asm__ __volatile__("wrmsr" ::"c"(0xc0000101u), "a"((uint32_t)base), "d"((uint32_t)(base >> 32)) : "memory");
+#elif defined(__aarch64__)
+  __asm__ __volatile__("msr tpidr_el1, %0" ::"r"(c) : "memory");
+#elif defined(__riscv)
+  __asm__ __volatile__("mv tp, %0" ::"r"(c) : "memory");
+#elif defined(__loongarch64)
+  __asm__ __volatile__("move $tp, %0" ::"r"(c) : "memory");
+#endif
+}
+
+/* Disable interrupts on this CPU, returning the previous state. */
+static inline unsigned long irq_save(void)
+{
+  unsigned long flags;
+#if defined(__x86_64__)
+  __asm__ __volatile__("pushfq; popq %0; cli" : "=r"(flags)::"memory");
+#elif defined(__aarch64__)
+  __asm__ __volatile__("mrs %0, daif; msr daifset, #2" : "=r"(flags)::"memory");
+#elif defined(__riscv)
+  __asm__ __volatile__("csrrci %0, sstatus, 2" : "=r"(flags)::"memory");
+#elif defined(__loongarch64)
+  flags = 0;
+  __asm__ __volatile__("csrxchg %0, %1, 0x0" : "+r"(flags) : "r"(4ul) : "memory");
+#endif
+  return flags;
+}
+
+/* Restore the interrupt state returned by irq_save(). */
+static inline void irq_restore(unsigned long flags)
+{
+#if defined(__x86_64__)
+  __asm__ __volatile__("pushq %0; popfq" ::"r"(flags) : "memory", "cc");
+#elif defined(__aarch64__)
+  __asm__ __volatile__("msr daif, %0" ::"r"(flags) : "memory");
+#elif defined(__riscv)
+  __asm__ __volatile__("csrs sstatus, %0" ::"r"(flags & 2) : "memory");
+#elif defined(__loongarch64)
+  __asm__ __volatile__("csrxchg %0, %1, 0x0" : "+r"(flags) : "r"(4ul) : "memory");
+#endif
+}
+
+/* Free-running cycle counter: the TSC on x86_64, the generic timer or
+   time CSR elsewhere. Only differences between two reads are meaningful. */
+static inline uint64_t cpu_timestamp(void)
+{
+#if defined(__x86_64__)
+  uint32_t lo, hi;
+  __asm__ __volatile__("rdtsc" : "=a"(lo), "=d"(hi));
+  return ((uint64_t)hi << 32) | lo;
+#elif defined(__aarch64__)
+  uint64_t t;
+  __asm__ __volatile__("mrs %0, cntvct_el0" : "=r"(t));
+  return t;
+#elif defined(__riscv)
+  uint64_t t;
+  __asm__ __volatile__("rdtime %0" : "=r"(t));
+  return t;
+#elif defined(__loongarch64)
+  uint64_t t;
+  __asm__ __volatile__("rdtime.d %0, $zero" : "=r"(t));
+  return t;
+#endif
+}
+
+/* Spin-wait hint. */
+static inline void cpu_relax(void)
+{
+#if defined(__x86_64__)
+  __asm__ __volatile__("pause" ::: "memory");
+#else
+  __asm__ __volatile__("" ::: "memory");
+#endif
+}
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef _H_FB
+#define _H_FB 1
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include <limine.h>
+
+/* Framebuffer with a shadow copy in RAM. Everything draws into the back
+   buffer and marks the scanlines it changed with fb_damage(); fb_flush()
+   copies just those to the screen. Reads (scrolling, blending) come from
+   ordinary cached memory instead of the device, and on x86_64 the screen
+   is remapped write-combining so the flush streams at memory speed. */
+
+/* Take over `fb` (32 bits per pixel only). The back buffer comes from the
+   PMM; when it can't be had drawing goes straight to the screen. */
+bool fb_init(struct limine_framebuffer *fb);
+
+/* Back buffer: `fb_pitch()` pixels per scanline, fb_width() x fb_height()
+   of them visible. NULL before fb_init(). */
+uint32_t *fb_back(void);
+size_t fb_pitch(void);
+unsigned int fb_width(void);
+unsigned int fb_height(void);
+
+/* Scanlines [y0, y1) of the back buffer changed. */
+void fb_damage(unsigned int y0, unsigned int y1);
+
+/* Copy every damaged scanline to the screen. */
+void fb_flush(void);
+
+/* Whether the screen got mapped write-combining. */
+bool fb_write_combining(void);
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef _H_KLOG
+#define _H_KLOG 1
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <kernel/stdio/kstdio.h>
+
+/* Binary kernel log. klog() stores the format string's address, up to
+   KLOG_MAX_ARGS raw arguments and a timestamp into the calling CPU's ring
+   and returns; no formatting and no drawing. klog_drain() formats the
+   records later, oldest first across all CPUs, and prints each with one
+   kwrite().
+
+   Because only the format's address is kept, it must be a string literal,
+   and so must any %s argument. Timestamps are compared across CPUs, which
+   assumes their cycle counters run in step (an invariant TSC on x86_64).
+   A full ring drops new records and counts them; the next drain reports
+   the loss. */
+
+#define KLOG_MAX_ARGS 6
+#define KLOG_RING_RECORDS 128 // per CPU, a power of two
+
+struct klog_record
+{
+  uint64_t time; // cpu_timestamp()
+  const char *fmt;
+  uint64_t args[KLOG_MAX_ARGS];
+};
+
+void klog_write(const char *fmt, const uint64_t args[KLOG_MAX_ARGS]);
+
+/* Format up to `max` records; returns how many were printed. Only one CPU
+   drains at a time, others return 0 at once. */
+unsigned int klog_drain(unsigned int max);
+
+/* Records dropped on full rings since boot, all CPUs. */
+uint64_t klog_dropped(void);
+
+/* klog(fmt, ...) with at most KLOG_MAX_ARGS arguments. The dead kprintf()
+   call lets the compiler check the arguments against the format. */
+#define klog(fmt, ...)                                                                            \
+  do                                                                                              \
+  {                                                                                               \
+    if (0)                                                                                        \
+      kprintf(fmt, ##__VA_ARGS__);                                                                \
+    klog_write(fmt, (const uint64_t[KLOG_MAX_ARGS]){                                              \
+                        KLOG_CAT(KLOG_ARGS_, KLOG_NARGS(__VA_ARGS__))(__VA_ARGS__)});             \
+  } while (0)
+
+#define KLOG_CAT(a, b) KLOG_CAT_(a, b)
+#define KLOG_CAT_(a, b) a##b
+#define KLOG_NARGS(...) KLOG_NARGS_(_, ##__VA_ARGS__, 6, 5, 4, 3, 2, 1, 0)
+#define KLOG_NARGS_(_, a, b, c, d, e, f, n, ...) n
+#define KLOG_ARG(x) ((uint64_t)(uintptr_t)(x))
+#define KLOG_ARGS_0() 0
+#define KLOG_ARGS_1(a) KLOG_ARG(a)
+#define KLOG_ARGS_2(a, b) KLOG_ARG(a), KLOG_ARG(b)
+#define KLOG_ARGS_3(a, b, c) KLOG_ARG(a), KLOG_ARG(b), KLOG_ARG(c)
+#define KLOG_ARGS_4(a, b, c, d) KLOG_ARG(a), KLOG_ARG(b), KLOG_ARG(c), KLOG_ARG(d)
+#define KLOG_ARGS_5(a, b, c, d, e) KLOG_ARG(a), KLOG_ARG(b), KLOG_ARG(c), KLOG_ARG(d), KLOG_ARG(e)
+#define KLOG_ARGS_6(a, b, c, d, e, f) \
+  KLOG_ARG(a), KLOG_ARG(b), KLOG_ARG(c), KLOG_ARG(d), KLOG_ARG(e), KLOG_ARG(f)
+
+#endif
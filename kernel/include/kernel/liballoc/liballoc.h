@@ -1,20 +1,10 @@
 #ifndef _LIBALLOC_H
 #define _LIBALLOC_H
 
-// If we are told to not define our own size_t, then we
-// skip the define.
-#ifndef _ALLOC_SKIP_DEFINE
+#include <stdint.h>
+#include <stddef.h>
 
-#ifndef _HAVE_SIZE_T
-#define _HAVE_SIZE_T
-typedef unsigned int size_t;
-#endif
-
-#ifndef NULL
-#define NULL 0
-#endif
-
-#endif
+#define LIBALLOC_MAXEXP 32 //< Free lists, one per power-of-two exponent.
 
 #ifdef __cplusplus
 extern "C"
@@ -28,10 +18,10 @@ extern "C"
    */
   struct boundary_tag
   {
-    unsigned int magic;     //< It's a kind of ...
-    unsigned int size;      //< Requested size.
-    unsigned int real_size; //< Actual size.
-    int index;              //< Location in the page table.
+    unsigned int magic; //< It's a kind of ...
+    size_t size;        //< Requested size.
+    size_t real_size;   //< Actual size.
+    int index;          //< Location in the page table.
 
     struct boundary_tag *split_left;  //< Linked-list info for broken pages.
     struct boundary_tag *split_right; //< The same.
@@ -64,7 +54,7 @@ extern "C"
    * \return NULL if the pages were not allocated.
    * \return A pointer to the allocated memory.
    */
-  extern void *liballoc_alloc(int);
+  extern void *liballoc_alloc(size_t);
 
   /** This frees previously allocated memory. The void* parameter passed
    * to the function is the exact same value returned from a previous
@@ -74,13 +64,72 @@ extern "C"
    *
    * \return 0 if the memory was successfully freed.
    */
-  extern int liballoc_free(void *, int);
+  extern int liballoc_free(void *, size_t);
+
+  /** Like liballoc_alloc, but the pages start at a multiple of the second
+   * parameter, a power of two of at least the page size. Used for large
+   * alignments; the pages are released with liballoc_free.
+   *
+   * \return NULL if the pages were not allocated.
+   */
+  extern void *liballoc_alloc_aligned(size_t, size_t);
 
   void *malloc(size_t);          //< The standard function.
   void *realloc(void *, size_t); //< The standard function.
   void *calloc(size_t, size_t);  //< The standard function.
   void free(void *);             //< The standard function.
 
+  /** Bytes actually usable at a malloc()ed pointer, which may be more than
+   * were asked for. Growing into them needs no realloc().
+   */
+  size_t malloc_usable_size(void *);
+
+  void *aligned_alloc(size_t, size_t);         //< The standard function.
+  int posix_memalign(void **, size_t, size_t); //< The standard function.
+
+  /** `size` bytes at a multiple of `align`, which must be a power of two.
+   * Unlike aligned_alloc() the size need not be a multiple of the alignment.
+   * Cache-line alignments come from the slab size classes, page alignments
+   * and up straight from liballoc_alloc_aligned. Release with free().
+   */
+  void *kmalloc_aligned(size_t size, size_t align);
+
+  /** A snapshot of the heap counters. They are always kept, at the cost of
+   * a few relaxed atomic adds per call, so the heap can be sized from data.
+   * Byte counts cover the tagged and large paths; the slab size classes
+   * report separately.
+   */
+  struct heap_stats
+  {
+    size_t bytes_in_use;   //< Bytes handed out (as requested).
+    size_t bytes_reserved; //< Bytes held from the page allocator.
+    size_t peak_in_use;
+    size_t peak_reserved;
+
+    uint64_t allocs;       //< Tagged and large allocations.
+    uint64_t frees;
+    uint64_t large_allocs; //< Allocations that took their own page run.
+    uint64_t large_frees;
+    uint64_t pages_taken;    //< Pages obtained through liballoc_alloc.
+    uint64_t pages_returned; //< Pages given back through liballoc_free.
+
+    uint64_t splits; //< Tags split in two.
+    uint64_t melts;  //< Neighbouring tags merged.
+    uint64_t realloc_in_place;
+    uint64_t realloc_moved;
+
+    uint64_t allocs_by_exp[LIBALLOC_MAXEXP]; //< Tagged allocations per request exponent.
+    size_t free_tags[LIBALLOC_MAXEXP];       //< Length of each free list.
+    int complete_pages[LIBALLOC_MAXEXP];     //< Whole, unsplit regions parked on each list.
+
+    size_t slab_bytes_in_use;   //< Size-class objects out of their caches, including per-CPU stacks.
+    size_t slab_bytes_reserved; //< Bytes in size-class slabs.
+    uint64_t slab_cpu_hits;     //< Size-class calls served by per-CPU stacks.
+    uint64_t slab_cpu_misses;
+  };
+
+  void heap_stats(struct heap_stats *out);
+
 #ifdef __cplusplus
 }
 #endif
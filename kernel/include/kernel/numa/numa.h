@@ -0,0 +1,37 @@
+#ifndef _H_NUMA
+#define _H_NUMA 1
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <kernel/cpu/cpu.h>
+
+#define NUMA_MAX_NODES 8
+
+/* Read the memory and CPU affinity of each node from the ACPI SRAT. Without
+   an SRAT (or with a single proximity domain) everything is node 0. */
+void numa_init(void);
+
+unsigned int numa_node_count(void);
+
+/* Node owning a physical page (by page number). */
+unsigned int numa_page_node(size_t page);
+
+/* First page after `page` at which numa_page_node() may change. */
+size_t numa_range_end(size_t page);
+
+/* Bind a CPU index to its hardware id (the (x2)APIC id on x86_64, the
+   full 64-bit MPIDR elsewhere) so it picks up the node SRAT gives that id.
+   CPUs that were never registered belong to node 0. */
+void numa_register_cpu(unsigned int cpu, uint64_t hw_id);
+
+unsigned int numa_cpu_node(unsigned int cpu);
+
+/* Node of the CPU we are running on, cached in its per-CPU block by
+   smp_init(). */
+static inline unsigned int numa_local_node(void)
+{
+  return this_cpu()->node;
+}
+
+#endif
@@ -7,45 +7,117 @@
 #include <string.h>
 #include <stdbool.h>
 
-static inline unsigned long irq_save(void);
-
-static inline void irq_restore(unsigned long flags);
+#include <kernel/cpu/cpu.h>
 
 void *memset(void *s, int c, size_t n);
 
 #define PAGE_SIZE 4096
 
-#define BIT_SET(i) (pmm_bitmap[(i) / 8] |= (1u << ((i) % 8)))
-#define BIT_CLEAR(i) (pmm_bitmap[(i) / 8] &= ~(1u << ((i) % 8)))
-#define BIT_TEST(i) (pmm_bitmap[(i) / 8] & (1u << ((i) % 8)))
+/* Largest buddy block is 2^PMM_MAX_ORDER pages (4 MiB). */
+#define PMM_MAX_ORDER 10
 
-extern char _kernel_end;
+/* Physical memory zones, lowest first. */
+#define PMM_ZONE_DMA 0    // below 16 MiB
+#define PMM_ZONE_DMA32 1  // below 4 GiB
+#define PMM_ZONE_NORMAL 2 // everything else
+#define PMM_ZONE_COUNT 3
 
-/* ---- PMM bitmap globals ---- */
-static uint8_t *pmm_bitmap; // virtual pointer to bitmap storage
-static size_t pmm_total_pages;
-static size_t pmm_bitmap_bytes;
-static uintptr_t pmm_bitmap_phys;  // physical base of bitmap
-static uintptr_t pmm_bitmap_pages; // number of pages used by bitmap
+/* Allocation flags. Without a zone flag any zone may be used, Normal first;
+   lower zones are only touched once the higher ones are exhausted. */
+#define PMM_DMA (1u << 0)      // only ZONE_DMA
+#define PMM_DMA32 (1u << 1)    // ZONE_DMA32 or below, for 32-bit DMA devices
+#define PMM_LOCAL (1u << 2)    // prefer the calling CPU's NUMA node
+#define PMM_THISNODE (1u << 3) // only the calling CPU's NUMA node
+#define PMM_DEFAULT PMM_LOCAL
+
+extern char _kernel_end;
 
-/* bitmap helpers */
-#define BIT_SET(i) (pmm_bitmap[(i) / 8] |= (1u << ((i) % 8)))
-#define BIT_CLEAR(i) (pmm_bitmap[(i) / 8] &= ~(1u << ((i) % 8)))
-#define BIT_TEST(i) (pmm_bitmap[(i) / 8] & (1u << ((i) % 8)))
+uintptr_t hhdm_offset(void);
 
-static inline uintptr_t hhdm_offset(void);
 /* Convert a physical address to a kernel virtual (HHDM) pointer */
-static inline void *phys_to_virt(uintptr_t phys);
+static inline void *phys_to_virt(uintptr_t phys)
+{
+  return (void *)(phys + hhdm_offset());
+}
 
 /* Convert a kernel virtual (HHDM) pointer back to physical */
-static inline uintptr_t virt_to_phys(const void *virt);
+static inline uintptr_t virt_to_phys(const void *virt)
+{
+  return (uintptr_t)virt - hhdm_offset();
+}
 
-static inline uintptr_t align_up(uintptr_t a, uintptr_t align);
-static inline uintptr_t align_down(uintptr_t a, uintptr_t align);
+static inline uintptr_t align_up(uintptr_t a, uintptr_t align)
+{
+  return (a + align - 1) & ~(align - 1);
+}
+static inline uintptr_t align_down(uintptr_t a, uintptr_t align)
+{
+  return a & ~(align - 1);
+}
 
 void pmm_init_after_kernel(void);
 
 uintptr_t pmm_alloc_pages(size_t pages);
+uintptr_t pmm_alloc_pages_flags(size_t pages, unsigned int flags);
 void pmm_free_pages(uintptr_t phys_addr, size_t pages);
 
+/* `pages` pages whose physical address is a multiple of `align` bytes (a
+   power of two). An `align` of 0, or anything up to PAGE_SIZE, asks for
+   plain page alignment, like pmm_alloc_pages(). Free with
+   pmm_free_pages(). */
+uintptr_t pmm_alloc_aligned(size_t pages, size_t align);
+
+/* Buddy interface: naturally aligned blocks of 2^order pages. */
+uintptr_t pmm_alloc_order(unsigned int order);
+uintptr_t pmm_alloc_order_flags(unsigned int order, unsigned int flags);
+void pmm_free_order(uintptr_t phys_addr, unsigned int order);
+
+/* Huge page pool: 2 MiB chunks aligned to 2 MiB, reserved at init so large
+   buffers can be mapped with large pages. pmm_huge_alloc() falls back to
+   the buddy allocator when the pool is empty. */
+#define PMM_HUGE_SIZE (2ul << 20)
+
+uintptr_t pmm_huge_alloc(void);
+void pmm_huge_free(uintptr_t phys_addr);
+
+/* Move up to `chunks` more 2 MiB chunks into the pool. Returns how many. */
+size_t pmm_huge_reserve(size_t chunks);
+
+bool pmm_check(void);
+
+struct pmm_stats
+{
+  size_t total_pages;       // pages covered by the bitmap
+  size_t usable_pages;      // pages the memmap reported usable
+  size_t free_pages;        // pages on the buddy free lists
+  size_t deferred_pages;    // usable pages not yet released by deferred init
+  uint64_t init_cycles;     // cpu_timestamp() ticks spent in pmm_init_after_kernel
+  uint64_t deferred_cycles; // ticks spent releasing deferred memory after boot
+  unsigned int nodes;       // NUMA nodes
+  size_t huge_free;         // chunks sitting in the huge page pool
+  size_t huge_reserved;     // chunks the huge page pool holds on to
+  // Free pages per zone, summed over all nodes.
+  size_t zone_free_pages[PMM_ZONE_COUNT];
+};
+
+void pmm_get_stats(struct pmm_stats *out);
+
+/* Release up to `pages` more of the memory held back at boot. Returns the
+   number of pages consumed, 0 once all usable memory is initialized. */
+size_t pmm_deferred_init_step(size_t pages);
+
+/* Per-CPU page magazine counters, summed over all CPUs. */
+struct pmm_magazine_stats
+{
+  uint64_t alloc_hits;   // single pages served from a CPU's magazines
+  uint64_t alloc_misses; // single page allocations that went to the depot/buddy
+  uint64_t free_hits;    // single pages absorbed by a CPU's magazines
+  uint64_t free_misses;  // single page frees that went to the depot/buddy
+  uint64_t refills;      // magazines filled from the buddy allocator
+  uint64_t drains;       // magazines emptied back into the buddy allocator
+  size_t depot_full;     // full magazines parked in the depot right now
+};
+
+void pmm_magazine_stats(struct pmm_magazine_stats *out);
+
 #endif
\ No newline at end of file
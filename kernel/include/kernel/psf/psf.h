@@ -2,9 +2,12 @@
 #define _H_PSF 1
 
 #include <stdint.h>
+#include <stddef.h>
 
-extern char _binary_zap_ext_light32_psf_start;
-extern char _binary_zap_ext_light32_psf_end;
+#include <limine.h>
+
+extern char _binary_zap_ext_light32_psf_start[];
+extern char _binary_zap_ext_light32_psf_end[];
 
 #define PSF_FONT_MAGIC 0x864ab572
 
@@ -20,7 +23,25 @@ typedef struct
   uint32_t width;         /* width in pixels */
 } PSF_font;
 
+/* Glyphs kept pre-rendered by psf_set_colors(): every byte value. */
+#define PSF_ATLAS_GLYPHS 256
+
 void psf_init();
+
+/* Glyph cell size of the built-in font, in pixels. */
+unsigned int psf_width(void);
+unsigned int psf_height(void);
+
+/* Pre-render the glyphs in these colours, which psf_draw() then copies
+   instead of rendering. Needs the heap; without it drawing still works,
+   just slower. */
+void psf_set_colors(uint32_t fg, uint32_t bg);
+
+/* Draw glyph `c` with its top-left pixel at `dst`, in a 32-bit pixel
+   buffer `pitch` pixels wide. */
+void psf_draw(uint32_t *dst, size_t pitch, unsigned int c, uint32_t fg, uint32_t bg);
+
+/* Draw `c` in text cell (cx, cy) of `fb`. */
 void putc(struct limine_framebuffer *fb, char c, int cx, int cy, uint32_t fg, uint32_t bg);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,37 @@
+#ifndef _H_SERIAL
+#define _H_SERIAL 1
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/* COM1 log sink. Writers copy into a lock-free ring and move on; the ring
+   is drained into the UART's FIFO a FIFO-load at a time by serial_poll(),
+   by writers that find it full, or by serial_irq() once something routes
+   the UART's transmit-empty interrupt to it. Only x86_64 has the port;
+   elsewhere every call does nothing. */
+
+#define SERIAL_COM1 0x3f8
+#define SERIAL_BAUD 115200
+#define SERIAL_RING_SIZE 16384 // bytes, a power of two
+
+/* Program COM1 for 8N1 at SERIAL_BAUD with FIFOs on. Returns false when no
+   UART answers, after which writes are dropped. */
+bool serial_init(void);
+
+/* Queue `len` bytes, turning "\n" into "\r\n". Nothing reaches the UART
+   until the next serial_poll(), unless the ring fills up, in which case the
+   writer drains it itself. */
+void serial_write(const char *buf, size_t len);
+
+/* Move what the UART can take right now from the ring into its FIFO.
+   Never waits. */
+void serial_poll(void);
+
+/* Drain the ring completely, waiting on the UART. */
+void serial_flush(void);
+
+/* Transmit-holding-register-empty interrupt handler. */
+void serial_irq(void);
+
+#endif
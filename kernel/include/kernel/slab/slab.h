@@ -0,0 +1,68 @@
+#ifndef _H_SLAB
+#define _H_SLAB 1
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/* Largest request the kmem_alloc() size classes serve. */
+#define KMEM_MAX_SIZE 2048
+
+struct kmem_cache;
+
+/* Set up the slab layer and the kmem_alloc() size classes. Needs the PMM. */
+void kmem_init(void);
+
+/* A cache of `size`-byte objects. `align` 0 means cache-line friendly: objects
+   of a cache line or more start on a line, smaller ones are packed so none
+   straddles one. `ctor`, if given, runs once per object when its slab is
+   created; objects must be freed back in their constructed state. */
+struct kmem_cache *kmem_cache_create(const char *name, size_t size, size_t align, void (*ctor)(void *));
+
+/* Destroy an empty cache. Fails (returns false) while objects are still
+   allocated from it. */
+bool kmem_cache_destroy(struct kmem_cache *cache);
+
+void *kmem_cache_alloc(struct kmem_cache *cache);
+void kmem_cache_free(struct kmem_cache *cache, void *obj);
+
+struct kmem_cache_stats
+{
+  const char *name;
+  size_t object_size;        // bytes per object, including alignment padding
+  unsigned int slab_order;   // each slab is a 2^slab_order page PMM block
+  unsigned int slab_objects; // objects per slab
+  size_t slabs;              // slabs currently held
+  size_t active_objects;     // objects handed out
+  size_t total_objects;      // objects in all held slabs
+  uint64_t allocs;
+  uint64_t frees;
+  uint64_t slabs_created;
+  uint64_t slabs_freed;
+};
+
+void kmem_cache_stats(struct kmem_cache *cache, struct kmem_cache_stats *out);
+
+/* Power-of-two size classes on top of kmem caches, used for small malloc()s.
+   kmem_alloc() returns NULL for sizes above KMEM_MAX_SIZE or before
+   kmem_init(). kmem_free() returns false when `ptr` is not a slab object,
+   kmem_size() returns 0 in that case. */
+void *kmem_alloc(size_t size);
+bool kmem_free(void *ptr);
+size_t kmem_size(const void *ptr);
+
+/* A size-class object aligned to `align` bytes (a power of two), freed with
+   kmem_free(). Classes of a cache line or more start on a line and smaller
+   ones are naturally aligned, so alignments up to CACHE_LINE_SIZE are served
+   by rounding the size up; larger ones get NULL. */
+void *kmem_alloc_aligned(size_t size, size_t align);
+
+/* kmem_alloc()/kmem_free() calls served by the per-CPU stacks (hits) and
+   those that had to go to a class cache (misses), summed over all CPUs. */
+void kmem_cpu_stats(uint64_t *hits, uint64_t *misses);
+
+/* Bytes of size-class objects handed out (objects parked in per-CPU stacks
+   count as handed out) and bytes in size-class slabs. */
+void kmem_class_usage(size_t *active_bytes, size_t *slab_bytes);
+
+#endif
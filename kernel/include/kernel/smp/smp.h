@@ -0,0 +1,28 @@
+#ifndef _H_SMP
+#define _H_SMP 1
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <kernel/cpu/cpu.h>
+
+// Pages of stack given to each AP.
+#define SMP_STACK_PAGES 4
+
+/* Install the BSP's per-CPU block. The first thing kmain does: cpu_id()
+   and everything built on it need it. */
+void smp_init_bsp(void);
+
+/* Start every other CPU the bootloader found, up to MAX_CPUS. Each gets a
+   per-CPU block and a stack of its own, registers with NUMA, then runs
+   `entry`, which must not return. Needs the PMM. Returns the number of
+   CPUs online, the BSP included. */
+unsigned int smp_init(void (*entry)(void));
+
+/* CPUs online so far, the BSP included. */
+unsigned int smp_cpu_count(void);
+
+/* Block of CPU `id`, for looking at other CPUs' state. */
+struct cpu_local *smp_cpu(unsigned int id);
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef _H_SPINLOCK
+#define _H_SPINLOCK 1
+
+#include <kernel/cpu/cpu.h>
+
+typedef struct
+{
+  volatile int locked;
+} spinlock_t;
+
+#define SPINLOCK_INIT {0}
+
+static inline void spin_lock(spinlock_t *lock)
+{
+  while (__atomic_exchange_n(&lock->locked, 1, __ATOMIC_ACQUIRE))
+  {
+    // Wait on a plain load so the line is not bounced between waiters.
+    while (__atomic_load_n(&lock->locked, __ATOMIC_RELAXED))
+      cpu_relax();
+  }
+}
+
+static inline void spin_unlock(spinlock_t *lock)
+{
+  __atomic_store_n(&lock->locked, 0, __ATOMIC_RELEASE);
+}
+
+/* Take the lock with interrupts disabled on this CPU. */
+static inline unsigned long spin_lock_irqsave(spinlock_t *lock)
+{
+  unsigned long flags = irq_save();
+  spin_lock(lock);
+  return flags;
+}
+
+static inline void spin_unlock_irqrestore(spinlock_t *lock, unsigned long flags)
+{
+  spin_unlock(lock);
+  irq_restore(flags);
+}
+
+#endif
@@ -1,4 +1,29 @@
 #ifndef _H_KSTDIO
 #define _H_KSTDIO 1
 
-#endif
\ No newline at end of file
+#include <stddef.h>
+#include <stdarg.h>
+
+/* Kernel output. Everything goes to the framebuffer console, which is
+   flushed with console_flush_soon() after each call, and to COM1 (see
+   serial.h), so `qemu -serial stdio` shows it too. */
+
+// Longest kprintf() message; anything past it is cut off.
+#define KPRINTF_MAX 512
+
+void kwrite(const char *buf, size_t len);
+void kputs(const char *s);
+
+/* printf without floating point: %c %s %d %i %u %x %X %p %%, the flags
+   - 0 + space #, field width and precision (either may be *), and the hh h
+   l ll z t j length modifiers. %p prints 0x and the hex digits. Never
+   allocates. */
+int kprintf(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+int kvprintf(const char *fmt, va_list ap) __attribute__((format(printf, 1, 0)));
+
+/* As snprintf(): at most size - 1 bytes and a NUL into buf, returning the
+   length the whole message would have had. */
+int ksnprintf(char *buf, size_t size, const char *fmt, ...) __attribute__((format(printf, 3, 4)));
+int kvsnprintf(char *buf, size_t size, const char *fmt, va_list ap) __attribute__((format(printf, 3, 0)));
+
+#endif
@@ -0,0 +1,72 @@
+#include <kernel/acpi/acpi.h>
+
+#include <limine.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include <kernel/pmm/pmm.h>
+
+__attribute__((used, section(".limine_requests"))) static volatile struct limine_rsdp_request rsdp_req = {
+    .id = LIMINE_RSDP_REQUEST,
+    .revision = 0};
+
+struct acpi_rsdp
+{
+  char signature[8]; // "RSD PTR "
+  uint8_t checksum;
+  char oem_id[6];
+  uint8_t revision; // 0 = ACPI 1.0 (RSDT only), 2+ = has XSDT
+  uint32_t rsdt_address;
+  uint32_t length;
+  uint64_t xsdt_address;
+  uint8_t extended_checksum;
+  uint8_t reserved[3];
+} __attribute__((packed));
+
+/* Table addresses are physical; older Limine base revisions hand out the
+   RSDP through the HHDM already. */
+static void *acpi_map(uintptr_t addr)
+{
+  if (addr >= hhdm_offset())
+    return (void *)addr;
+  return phys_to_virt(addr);
+}
+
+static bool acpi_checksum_ok(const void *table, size_t length)
+{
+  const uint8_t *p = table;
+  uint8_t sum = 0;
+  for (size_t i = 0; i < length; i++)
+    sum += p[i];
+  return sum == 0;
+}
+
+struct acpi_sdt_header *acpi_find_table(const char *signature)
+{
+  if (!rsdp_req.response || !rsdp_req.response->address)
+    return NULL;
+
+  struct acpi_rsdp *rsdp = acpi_map((uintptr_t)rsdp_req.response->address);
+  if (memcmp(rsdp->signature, "RSD PTR ", 8) != 0)
+    return NULL;
+
+  // Prefer the XSDT (64-bit entries), fall back to the RSDT (32-bit entries).
+  bool xsdt = rsdp->revision >= 2 && rsdp->xsdt_address;
+  struct acpi_sdt_header *root = acpi_map(xsdt ? rsdp->xsdt_address : rsdp->rsdt_address);
+  size_t entry_size = xsdt ? 8 : 4;
+  size_t entries = (root->length - sizeof(struct acpi_sdt_header)) / entry_size;
+  const uint8_t *p = (const uint8_t *)(root + 1);
+
+  for (size_t i = 0; i < entries; i++)
+  {
+    uint64_t addr = 0;
+    memcpy(&addr, p + i * entry_size, entry_size);
+    struct acpi_sdt_header *table = acpi_map(addr);
+    if (memcmp(table->signature, signature, 4) == 0 && acpi_checksum_ok(table, table->length))
+      return table;
+  }
+
+  return NULL;
+}
@@ -0,0 +1,139 @@
+#include <kernel/alloctrace/alloctrace.h>
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include <kernel/cpu/cpu.h>
+
+/* ---- allocation trace ring ----
+   A power-of-two array of fixed-size events. Writers claim a slot with one
+   atomic increment of `head` and fill it in; nothing else is shared, so any
+   CPU can record without a lock. When the ring is full the oldest events
+   are overwritten. */
+
+bool alloctrace_on;
+
+static struct alloctrace_event *ring;
+static uint64_t ring_mask;
+static uint64_t head; // events ever recorded
+
+void alloctrace_start(void *buf, size_t bytes)
+{
+  size_t capacity = 1;
+
+  __atomic_store_n(&alloctrace_on, false, __ATOMIC_RELEASE);
+  if (bytes < sizeof(struct alloctrace_event))
+    return;
+  while (capacity * 2 <= bytes / sizeof(struct alloctrace_event))
+    capacity *= 2;
+
+  ring = buf;
+  ring_mask = capacity - 1;
+  __atomic_store_n(&head, 0, __ATOMIC_RELAXED);
+  __atomic_store_n(&alloctrace_on, true, __ATOMIC_RELEASE);
+}
+
+void alloctrace_stop(void)
+{
+  __atomic_store_n(&alloctrace_on, false, __ATOMIC_RELEASE);
+}
+
+uint64_t alloctrace_count(void)
+{
+  return __atomic_load_n(&head, __ATOMIC_RELAXED);
+}
+
+static inline uint32_t saturate(uint64_t v)
+{
+  return v > UINT32_MAX ? UINT32_MAX : (uint32_t)v;
+}
+
+void alloctrace_record(unsigned int op, uint64_t start, size_t size, const void *ptr, const void *old,
+                       size_t align)
+{
+  uint64_t now = cpu_timestamp();
+  // Tracing came on during the call.
+  if (start == 0)
+    start = now;
+
+  uint64_t index = __atomic_fetch_add(&head, 1, __ATOMIC_RELAXED);
+  struct alloctrace_event *ev = &ring[index & ring_mask];
+
+  ev->time = (uint32_t)(start >> ALLOCTRACE_TIME_SHIFT);
+  ev->cycles = saturate(now - start);
+  ev->size = saturate(size);
+  ev->id = alloctrace_id(ptr);
+  ev->old_id = alloctrace_id(old);
+  ev->op = (uint8_t)op;
+  ev->cpu = (uint8_t)cpu_id();
+  ev->align_log2 = align ? (uint8_t)__builtin_ctzl(align) : 0;
+  ev->reserved = 0;
+}
+
+/* No printf in here: the dump may be all that works when something is
+   badly wrong with the heap. */
+static size_t put_dec(char *out, uint64_t v)
+{
+  char tmp[20];
+  size_t n = 0, len = 0;
+
+  do
+  {
+    tmp[n++] = (char)('0' + v % 10);
+    v /= 10;
+  } while (v);
+  while (n)
+    out[len++] = tmp[--n];
+  return len;
+}
+
+static size_t put_str(char *out, const char *s)
+{
+  size_t len = 0;
+  while (s[len])
+  {
+    out[len] = s[len];
+    len++;
+  }
+  return len;
+}
+
+void alloctrace_dump(void (*write)(const char *buf, size_t len))
+{
+  static const char hex[] = "0123456789abcdef";
+  char line[2 * sizeof(struct alloctrace_event) + 1];
+  char header[128];
+  size_t len = 0;
+
+  uint64_t count = alloctrace_count();
+  uint64_t capacity = ring ? ring_mask + 1 : 0;
+  uint64_t kept = count < capacity ? count : capacity;
+
+  len += put_str(header + len, "alloctrace begin version=");
+  len += put_dec(header + len, ALLOCTRACE_VERSION);
+  len += put_str(header + len, " events=");
+  len += put_dec(header + len, kept);
+  len += put_str(header + len, " dropped=");
+  len += put_dec(header + len, count - kept);
+  len += put_str(header + len, " time_shift=");
+  len += put_dec(header + len, ALLOCTRACE_TIME_SHIFT);
+  len += put_str(header + len, " event_size=");
+  len += put_dec(header + len, sizeof(struct alloctrace_event));
+  header[len++] = '\n';
+  write(header, len);
+
+  for (uint64_t i = count - kept; i < count; i++)
+  {
+    const unsigned char *bytes = (const unsigned char *)&ring[i & ring_mask];
+    for (size_t b = 0; b < sizeof(struct alloctrace_event); b++)
+    {
+      line[2 * b] = hex[bytes[b] >> 4];
+      line[2 * b + 1] = hex[bytes[b] & 15];
+    }
+    line[sizeof(line) - 1] = '\n';
+    write(line, sizeof(line));
+  }
+
+  write("alloctrace end\n", 15);
+}
@@ -0,0 +1,287 @@
+#include <kernel/console/console.h>
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include <kernel/cpu/cpu.h>
+#include <kernel/fb/fb.h>
+#include <kernel/liballoc/liballoc.h>
+#include <kernel/psf/psf.h>
+#include <kernel/spinlock/spinlock.h>
+
+/* ---- framebuffer text console ----
+   The screen is a rows x cols grid of cells. Writing a character only
+   stores it in its cell and widens that row's dirty span; console_flush()
+   draws the dirty spans into the back buffer with the PSF font and has
+   fb_flush() copy the scanlines of those rows to the screen. Cells that are
+   rewritten with what they already hold are not marked at all.
+
+   The rows form a ring: scrolling moves `head` on by one and blanks the
+   row that falls off the top, with no copying. The pixels cannot scroll
+   that way, so the next flush compares every screen row with `shown`,
+   the cells the back buffer currently holds, and draws only the cells
+   that differ. However many lines scrolled by in between, a flush draws
+   each changed cell at most once. */
+
+struct console_cell
+{
+  uint8_t ch;
+  uint8_t attr;
+};
+
+static const uint32_t palette[16] = {
+    0x000000, 0x0000aa, 0x00aa00, 0x00aaaa, 0xaa0000, 0xaa00aa, 0xaa5500, 0xaaaaaa,
+    0x555555, 0x5555ff, 0x55ff55, 0x55ffff, 0xff5555, 0xff55ff, 0xffff55, 0xffffff,
+};
+
+static spinlock_t console_lock = SPINLOCK_INIT;
+
+static uint32_t *pixels; // the fb back buffer
+static size_t pitch;      // in pixels
+static unsigned int cell_w, cell_h;
+static unsigned int cols, rows;
+
+static struct console_cell *cells; // rows * cols, screen row r at ring row (head + r) % rows
+static struct console_cell *shown; // rows * cols, by screen row
+static unsigned int head;
+static bool scrolled;      // head moved since the last flush
+static uint16_t *dirty_lo; // per screen row: cells [lo, hi) need drawing
+static uint16_t *dirty_hi; // hi == 0: row is clean
+
+static uint64_t last_flush; // cpu_timestamp() at the last flush
+
+static unsigned int cur_x, cur_y;
+static uint8_t cur_attr = CONSOLE_DEFAULT_ATTR;
+
+static inline struct console_cell *row_cells(unsigned int row)
+{
+  unsigned int ring = head + row;
+  return &cells[(ring < rows ? ring : ring - rows) * cols];
+}
+
+static void mark(unsigned int row, unsigned int lo, unsigned int hi)
+{
+  if (dirty_hi[row] == 0)
+  {
+    dirty_lo[row] = lo;
+    dirty_hi[row] = hi;
+    return;
+  }
+  if (lo < dirty_lo[row])
+    dirty_lo[row] = lo;
+  if (hi > dirty_hi[row])
+    dirty_hi[row] = hi;
+}
+
+static void scroll(void)
+{
+  // The old top row becomes the new bottom one.
+  struct console_cell *cell = row_cells(0);
+  for (unsigned int c = 0; c < cols; c++)
+    cell[c] = (struct console_cell){' ', cur_attr};
+  head = head + 1 < rows ? head + 1 : 0;
+  scrolled = true;
+}
+
+static void newline(void)
+{
+  cur_x = 0;
+  if (++cur_y == rows)
+  {
+    scroll();
+    cur_y = rows - 1;
+  }
+}
+
+static void put_cell(char c)
+{
+  // The cursor sits past the last column after writing there; wrap only
+  // once something else follows.
+  if (cur_x == cols)
+    newline();
+
+  struct console_cell *cell = row_cells(cur_y) + cur_x;
+  struct console_cell next = {(uint8_t)c, cur_attr};
+  if (cell->ch != next.ch || cell->attr != next.attr)
+  {
+    *cell = next;
+    mark(cur_y, cur_x, cur_x + 1);
+  }
+  cur_x++;
+}
+
+static void put_char(char c)
+{
+  switch (c)
+  {
+  case '\n':
+    newline();
+    break;
+  case '\r':
+    cur_x = 0;
+    break;
+  case '\b':
+    if (cur_x > 0)
+      cur_x--;
+    break;
+  case '\t':
+    do
+      put_cell(' ');
+    while (cur_x % CONSOLE_TAB != 0 && cur_x < cols);
+    break;
+  default:
+    put_cell(c);
+  }
+}
+
+static inline bool same_cell(struct console_cell a, struct console_cell b)
+{
+  return a.ch == b.ch && a.attr == b.attr;
+}
+
+/* Draw the cells of screen row `row` in [lo, hi) that differ from what the
+   back buffer shows. Returns whether anything was drawn. */
+static bool draw_row(unsigned int row, unsigned int lo, unsigned int hi)
+{
+  const struct console_cell *cell = row_cells(row);
+  struct console_cell *old = &shown[row * cols];
+
+  while (lo < hi && same_cell(cell[lo], old[lo]))
+    lo++;
+  while (hi > lo && same_cell(cell[hi - 1], old[hi - 1]))
+    hi--;
+  if (lo == hi)
+    return false;
+
+  uint32_t *dst = pixels + (size_t)row * cell_h * pitch + (size_t)lo * cell_w;
+  for (unsigned int c = lo; c < hi; c++, dst += cell_w)
+  {
+    psf_draw(dst, pitch, cell[c].ch, palette[cell[c].attr & 15], palette[cell[c].attr >> 4]);
+    old[c] = cell[c];
+  }
+  return true;
+}
+
+static void flush_locked(void)
+{
+  for (unsigned int row = 0; row < rows; row++)
+  {
+    bool drawn;
+    if (scrolled)
+      drawn = draw_row(row, 0, cols);
+    else if (dirty_hi[row] != 0)
+      drawn = draw_row(row, dirty_lo[row], dirty_hi[row]);
+    else
+      continue;
+
+    dirty_hi[row] = 0;
+    if (drawn)
+      fb_damage(row * cell_h, (row + 1) * cell_h);
+  }
+  scrolled = false;
+  fb_flush();
+  last_flush = cpu_timestamp();
+}
+
+bool console_init(void)
+{
+  if (fb_back() == NULL)
+    return false;
+
+  psf_init();
+  psf_set_colors(palette[CONSOLE_DEFAULT_ATTR & 15], palette[CONSOLE_DEFAULT_ATTR >> 4]);
+  unsigned int w = psf_width(), h = psf_height();
+  unsigned int ncols = fb_width() / w, nrows = fb_height() / h;
+  if (ncols == 0 || nrows == 0 || ncols > UINT16_MAX)
+    return false;
+
+  struct console_cell *grid = malloc((size_t)ncols * nrows * sizeof(*grid));
+  struct console_cell *screen = malloc((size_t)ncols * nrows * sizeof(*screen));
+  uint16_t *lo = malloc(nrows * sizeof(*lo));
+  uint16_t *hi = malloc(nrows * sizeof(*hi));
+  if (!grid || !screen || !lo || !hi)
+  {
+    free(grid);
+    free(screen);
+    free(lo);
+    free(hi);
+    return false;
+  }
+
+  unsigned long flags = spin_lock_irqsave(&console_lock);
+  pixels = fb_back();
+  pitch = fb_pitch();
+  cell_w = w;
+  cell_h = h;
+  cells = grid;
+  shown = screen;
+  head = 0;
+  scrolled = false;
+  dirty_lo = lo;
+  dirty_hi = hi;
+  cols = ncols;
+  rows = nrows;
+  cur_x = cur_y = 0;
+
+  // The margins right and below the grid never get drawn; blank them once.
+  for (size_t y = 0; y < fb_height(); y++)
+    for (size_t x = 0; x < fb_width(); x++)
+      pixels[y * pitch + x] = palette[cur_attr >> 4];
+  fb_damage(0, fb_height());
+  fb_flush();
+  for (size_t i = 0; i < (size_t)rows * cols; i++)
+    cells[i] = shown[i] = (struct console_cell){' ', cur_attr};
+  for (unsigned int row = 0; row < rows; row++)
+    dirty_hi[row] = 0;
+  spin_unlock_irqrestore(&console_lock, flags);
+  return true;
+}
+
+void console_write(const char *buf, size_t len)
+{
+  if (!cells)
+    return;
+
+  unsigned long flags = spin_lock_irqsave(&console_lock);
+  for (size_t i = 0; i < len; i++)
+    put_char(buf[i]);
+  spin_unlock_irqrestore(&console_lock, flags);
+}
+
+void console_flush(void)
+{
+  if (!cells)
+    return;
+
+  unsigned long flags = spin_lock_irqsave(&console_lock);
+  flush_locked();
+  spin_unlock_irqrestore(&console_lock, flags);
+}
+
+void console_flush_soon(void)
+{
+  if (!cells || cpu_timestamp() - last_flush < CONSOLE_FLUSH_TICKS)
+    return;
+
+  unsigned long flags = spin_lock_irqsave(&console_lock);
+  flush_locked();
+  spin_unlock_irqrestore(&console_lock, flags);
+}
+
+void console_set_attr(uint8_t attr)
+{
+  unsigned long flags = spin_lock_irqsave(&console_lock);
+  cur_attr = attr;
+  spin_unlock_irqrestore(&console_lock, flags);
+}
+
+unsigned int console_cols(void)
+{
+  return cols;
+}
+
+unsigned int console_rows(void)
+{
+  return rows;
+}
@@ -0,0 +1,235 @@
+#include <kernel/fb/fb.h>
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <kernel/pmm/pmm.h>
+#include <kernel/spinlock/spinlock.h>
+
+/* Remap the screen write-combining through the PAT. Build with
+   -DFB_WRITE_COMBINING=0 to leave the bootloader's mapping alone. */
+#ifndef FB_WRITE_COMBINING
+#define FB_WRITE_COMBINING 1
+#endif
+
+static uint32_t *front; // the device
+static uint32_t *back;  // shadow in RAM, or `front` without one
+static size_t pitch;    // pixels per scanline, the same in both
+static unsigned int width, height;
+static bool wc;
+
+// One bit per damaged scanline.
+static uint64_t *damage;
+static spinlock_t flush_lock = SPINLOCK_INIT;
+
+#if defined(__x86_64__)
+
+#define MSR_PAT 0x277
+#define PAT_WC 0x01
+
+#define PTE_PRESENT (1ull << 0)
+#define PTE_PWT (1ull << 3)
+#define PTE_PCD (1ull << 4)
+#define PTE_HUGE (1ull << 7)      // in PDPT and PD entries
+#define PTE_PAT_4K (1ull << 7)    // in PT entries
+#define PTE_PAT_HUGE (1ull << 12) // in huge PDPT and PD entries
+#define PTE_ADDR 0x000ffffffffff000ull
+
+static inline uint64_t rdmsr(uint32_t msr)
+{
+  uint32_t lo, hi;
+  __asm__ __volatile__("rdmsr" : "=a"(lo), "=d"(hi) : "c"(msr));
+  return ((uint64_t)hi << 32) | lo;
+}
+
+/* PTE bits selecting PAT entry `index`, for a 4 KiB or a huge page. */
+static uint64_t pat_bits(unsigned int index, bool huge)
+{
+  return (index & 1 ? PTE_PWT : 0) | (index & 2 ? PTE_PCD : 0) |
+         (index & 4 ? (huge ? PTE_PAT_HUGE : PTE_PAT_4K) : 0);
+}
+
+/* Point every page of [virt, virt + bytes) at PAT entry `index`. Pages that
+   also map something outside the range are left as they are. */
+static bool map_pat(uintptr_t virt, size_t bytes, unsigned int index)
+{
+  uint64_t cr3, cr4;
+  __asm__ __volatile__("mov %%cr3, %0" : "=r"(cr3));
+  __asm__ __volatile__("mov %%cr4, %0" : "=r"(cr4));
+  if (cr4 & (1ull << 12))
+    return false; // 5-level paging
+
+  const uint64_t mask = PTE_PWT | PTE_PCD;
+  uintptr_t lo = align_down(virt, 4096), hi = align_up(virt + bytes, 4096);
+  bool changed = false;
+
+  virt = lo;
+
+  while (virt < hi)
+  {
+    uint64_t *table = phys_to_virt(cr3 & PTE_ADDR);
+    uint64_t *entry = NULL;
+    size_t size = 0;
+
+    for (unsigned int level = 3;; level--)
+    {
+      uint64_t *e = &table[(virt >> (12 + 9 * level)) & 511];
+      size = 1ul << (12 + 9 * level);
+      if (!(*e & PTE_PRESENT))
+        break;
+      if (level == 0 || (level <= 2 && (*e & PTE_HUGE)))
+      {
+        entry = e;
+        break;
+      }
+      table = phys_to_virt(*e & PTE_ADDR);
+    }
+    if (!entry)
+      break;
+
+    bool huge = size > 4096;
+    uintptr_t page = virt & ~(size - 1);
+    if (page >= lo && page + size <= hi)
+    {
+      *entry = (*entry & ~(mask | (huge ? PTE_PAT_HUGE : PTE_PAT_4K))) | pat_bits(index, huge);
+      changed = true;
+    }
+    virt = page + size;
+  }
+
+  // Drop the stale translations.
+  if (changed)
+    __asm__ __volatile__("mov %0, %%cr3" ::"r"(cr3) : "memory");
+  return changed;
+}
+
+static bool map_write_combining(void *addr, size_t bytes)
+{
+  // Limine sets PAT entry 5 to WC, but look rather than assume.
+  uint64_t pat = rdmsr(MSR_PAT);
+  for (unsigned int i = 0; i < 8; i++)
+    if (((pat >> (8 * i)) & 7) == PAT_WC)
+      return map_pat((uintptr_t)addr, bytes, i);
+  return false;
+}
+
+#else
+
+static bool map_write_combining(void *addr, size_t bytes)
+{
+  (void)addr;
+  (void)bytes;
+  return false;
+}
+
+#endif
+
+bool fb_init(struct limine_framebuffer *fb)
+{
+  if (fb == NULL || fb->bpp != 32)
+    return false;
+
+  front = fb->address;
+  pitch = fb->pitch / 4;
+  width = fb->width;
+  height = fb->height;
+
+  size_t screen = pitch * height * sizeof(uint32_t);
+  size_t words = (height + 63) / 64;
+  size_t pages = (align_up(screen, 8) + words * sizeof(uint64_t) + PAGE_SIZE - 1) / PAGE_SIZE;
+  uintptr_t phys = pmm_alloc_pages(pages);
+  if (phys)
+  {
+    back = phys_to_virt(phys);
+    damage = (uint64_t *)((char *)back + align_up(screen, 8));
+    memset(damage, 0, words * sizeof(uint64_t));
+    // Never read the framebuffer back: it is uncached. Start from a black
+    // screen and let the first flush paint all of it.
+    memset(back, 0, screen);
+    fb_damage(0, height);
+  }
+  else
+    back = front;
+
+  if (FB_WRITE_COMBINING)
+    wc = map_write_combining(front, screen);
+  return true;
+}
+
+uint32_t *fb_back(void)
+{
+  return back;
+}
+
+size_t fb_pitch(void)
+{
+  return pitch;
+}
+
+unsigned int fb_width(void)
+{
+  return width;
+}
+
+unsigned int fb_height(void)
+{
+  return height;
+}
+
+bool fb_write_combining(void)
+{
+  return wc;
+}
+
+void fb_damage(unsigned int y0, unsigned int y1)
+{
+  if (!damage)
+    return;
+  if (y1 > height)
+    y1 = height;
+
+  while (y0 < y1)
+  {
+    unsigned int bit = y0 % 64, n = y1 - y0 < 64 - bit ? y1 - y0 : 64 - bit;
+    uint64_t bits = (n == 64 ? ~0ull : ((1ull << n) - 1)) << bit;
+    __atomic_fetch_or(&damage[y0 / 64], bits, __ATOMIC_RELAXED);
+    y0 += n;
+  }
+}
+
+void fb_flush(void)
+{
+  if (!damage)
+    return;
+
+  unsigned long flags = spin_lock_irqsave(&flush_lock);
+  size_t words = (height + 63) / 64;
+  unsigned int run = 0, run_len = 0;
+
+  // Both buffers share a pitch, so a run of scanlines is one copy.
+  for (size_t w = 0; w < words; w++)
+  {
+    uint64_t bits = __atomic_exchange_n(&damage[w], 0, __ATOMIC_RELAXED);
+    if (bits == 0 && run_len == 0)
+      continue;
+    for (unsigned int b = 0; b < 64; b++)
+    {
+      unsigned int y = w * 64 + b;
+      if (bits & (1ull << b))
+      {
+        if (run_len == 0)
+          run = y;
+        run_len++;
+        continue;
+      }
+      if (run_len)
+        memcpy(front + run * pitch, back + run * pitch, run_len * pitch * sizeof(uint32_t));
+      run_len = 0;
+    }
+  }
+  if (run_len)
+    memcpy(front + run * pitch, back + run * pitch, run_len * pitch * sizeof(uint32_t));
+  spin_unlock_irqrestore(&flush_lock, flags);
+}
@@ -0,0 +1,138 @@
+#include <kernel/klog/klog.h>
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include <kernel/cpu/cpu.h>
+#include <kernel/stdio/kstdio.h>
+
+/* One single-producer ring per CPU. The owning CPU appends with interrupts
+   off, so it never races itself; the drainer, on any CPU, consumes. head
+   and tail run freely and wrap. They live on separate cache lines so
+   producer and consumer do not bounce one line between them. */
+
+struct klog_cpu
+{
+  uint32_t head;    // written by the owner only
+  uint64_t dropped; // written by the owner only
+  bool active;
+  uint32_t tail __cacheline_aligned; // written by the drainer only
+  uint64_t reported;                 // drops already reported, drainer only
+  struct klog_record ring[KLOG_RING_RECORDS] __cacheline_aligned;
+} __cacheline_aligned;
+
+static struct klog_cpu klog_cpus[MAX_CPUS];
+static uint64_t active_cpus; // bit per CPU that has ever logged
+static uint64_t epoch;       // timestamp of the first record, shown as 0
+static bool draining;
+
+_Static_assert(MAX_CPUS <= 64, "active_cpus has one bit per CPU");
+
+void klog_write(const char *fmt, const uint64_t args[KLOG_MAX_ARGS])
+{
+  unsigned long flags = irq_save();
+  unsigned int cpu = cpu_id();
+  struct klog_cpu *c = &klog_cpus[cpu];
+  // Read inside the critical section so each ring is in time order.
+  uint64_t now = cpu_timestamp();
+
+  if (!c->active)
+  {
+    c->active = true;
+    uint64_t zero = 0;
+    __atomic_compare_exchange_n(&epoch, &zero, now, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+    __atomic_fetch_or(&active_cpus, 1ull << cpu, __ATOMIC_RELEASE);
+  }
+
+  uint32_t head = c->head;
+  if (head - __atomic_load_n(&c->tail, __ATOMIC_ACQUIRE) == KLOG_RING_RECORDS)
+  {
+    __atomic_store_n(&c->dropped, c->dropped + 1, __ATOMIC_RELAXED);
+    irq_restore(flags);
+    return;
+  }
+
+  struct klog_record *r = &c->ring[head & (KLOG_RING_RECORDS - 1)];
+  r->time = now;
+  r->fmt = fmt;
+  for (int i = 0; i < KLOG_MAX_ARGS; i++)
+    r->args[i] = args[i];
+  __atomic_store_n(&c->head, head + 1, __ATOMIC_RELEASE);
+  irq_restore(flags);
+}
+
+uint64_t klog_dropped(void)
+{
+  uint64_t n = 0;
+  for (unsigned int cpu = 0; cpu < MAX_CPUS; cpu++)
+    n += __atomic_load_n(&klog_cpus[cpu].dropped, __ATOMIC_RELAXED);
+  return n;
+}
+
+static void report_drops(uint64_t cpus)
+{
+  for (unsigned int cpu = 0; cpus; cpu++, cpus >>= 1)
+  {
+    struct klog_cpu *c = &klog_cpus[cpu];
+    if (!(cpus & 1))
+      continue;
+    uint64_t dropped = __atomic_load_n(&c->dropped, __ATOMIC_RELAXED);
+    if (dropped != c->reported)
+    {
+      kprintf("klog: cpu %u ring full, %llu records lost\n", cpu,
+              (unsigned long long)(dropped - c->reported));
+      c->reported = dropped;
+    }
+  }
+}
+
+unsigned int klog_drain(unsigned int max)
+{
+  if (__atomic_exchange_n(&draining, true, __ATOMIC_ACQUIRE))
+    return 0;
+
+  uint64_t cpus = __atomic_load_n(&active_cpus, __ATOMIC_ACQUIRE);
+  unsigned int done = 0;
+  report_drops(cpus);
+
+  while (done < max)
+  {
+    // Oldest record at the front of any ring.
+    struct klog_cpu *oldest = NULL;
+    unsigned int oldest_cpu = 0;
+    for (unsigned int cpu = 0; cpu < MAX_CPUS && cpus >> cpu; cpu++)
+    {
+      struct klog_cpu *c = &klog_cpus[cpu];
+      if (!(cpus >> cpu & 1) || c->tail == __atomic_load_n(&c->head, __ATOMIC_ACQUIRE))
+        continue;
+      if (!oldest || c->ring[c->tail & (KLOG_RING_RECORDS - 1)].time <
+                         oldest->ring[oldest->tail & (KLOG_RING_RECORDS - 1)].time)
+      {
+        oldest = c;
+        oldest_cpu = cpu;
+      }
+    }
+    if (!oldest)
+      break;
+
+    // Copy out and release the slot before the slow part.
+    struct klog_record r = oldest->ring[oldest->tail & (KLOG_RING_RECORDS - 1)];
+    __atomic_store_n(&oldest->tail, oldest->tail + 1, __ATOMIC_RELEASE);
+
+    // Every argument was widened to 64 bits, and a 64-bit vararg slot
+    // serves the narrower conversions just as well on our ABIs, so pass
+    // them all and let the format take what it uses.
+    char line[KPRINTF_MAX];
+    // Counters on other CPUs may lag the one that set the epoch.
+    uint64_t since = r.time > epoch ? r.time - epoch : 0;
+    int n = ksnprintf(line, sizeof(line), "[%llu c%u] ", (unsigned long long)since, oldest_cpu);
+    n += ksnprintf(line + n, sizeof(line) - n, r.fmt, r.args[0], r.args[1], r.args[2], r.args[3],
+                   r.args[4], r.args[5]);
+    kwrite(line, (size_t)n < sizeof(line) ? (size_t)n : sizeof(line) - 1);
+    done++;
+  }
+
+  __atomic_store_n(&draining, false, __ATOMIC_RELEASE);
+  return done;
+}
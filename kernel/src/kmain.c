@@ -6,7 +6,16 @@
 #include <limine.h>
 #include <string.h>
 
+#include <kernel/alloctrace/alloctrace.h>
+#include <kernel/console/console.h>
+#include <kernel/fb/fb.h>
+#include <kernel/klog/klog.h>
+#include <kernel/liballoc/liballoc.h>
 #include <kernel/pmm/pmm.h>
+#include <kernel/serial/serial.h>
+#include <kernel/smp/smp.h>
+#include <kernel/slab/slab.h>
+#include <kernel/spinlock/spinlock.h>
 #include <kernel/stdio/kstdio.h>
 
 // Set the base revision to 3, this is recommended as this is the latest
@@ -15,18 +24,37 @@
 
 __attribute__((used, section(".limine_requests"))) static volatile LIMINE_BASE_REVISION(3);
 
-static unsigned long liballoc_irqflags;
+// Boot milestones in cpu_timestamp() ticks since reset. Comparing
+// boot_ready_ticks between builds with and without PMM_DEFERRED_INIT shows
+// what deferring memory initialization saves.
+static uint64_t boot_kmain_ticks; // kmain entered
+static uint64_t boot_ready_ticks; // memory is up, kmain can get going
+
+// Pages of held-back memory initialized per pass of idle_loop().
+#define IDLE_DEFER_BATCH 16384
+
+// Pages to record heap activity into from boot on (see alloctrace.h); 0
+// leaves tracing off. Build with -DALLOCTRACE_BOOT_PAGES=n to turn it on.
+#ifndef ALLOCTRACE_BOOT_PAGES
+#define ALLOCTRACE_BOOT_PAGES 0
+#endif
+
+// The central liballoc heap. Small requests never get here: the slab
+// layer's per-CPU stacks serve them without a lock.
+static spinlock_t liballoc_spinlock = SPINLOCK_INIT;
+static unsigned long liballoc_irqflags; // only touched with the lock held
 
 int liballoc_lock(void)
 {
-    liballoc_irqflags = irq_save();
+    unsigned long flags = spin_lock_irqsave(&liballoc_spinlock);
+    liballoc_irqflags = flags;
     return 0;
 }
 
 int liballoc_unlock(void)
 {
     // Release lock first, then restore IF for this CPU.
-    irq_restore(liballoc_irqflags);
+    spin_unlock_irqrestore(&liballoc_spinlock, liballoc_irqflags);
     return 0;
 }
 
@@ -35,7 +63,20 @@ void *liballoc_alloc(size_t pages)
     if (pages == 0)
         return NULL;
 
-    uintptr_t phys = pmm_alloc_pages(pages);
+    // Heap memory: node-local, Normal zone first; DMA zones only as a last resort.
+    uintptr_t phys = pmm_alloc_pages_flags(pages, PMM_LOCAL);
+    if (!phys)
+        return NULL;
+
+    return phys_to_virt(phys);
+}
+
+void *liballoc_alloc_aligned(size_t pages, size_t align)
+{
+    if (pages == 0)
+        return NULL;
+
+    uintptr_t phys = pmm_alloc_aligned(pages, align);
     if (!phys)
         return NULL;
 
@@ -65,19 +106,48 @@ __attribute__((used, section(".limine_requests"))) static volatile struct limine
     .id = LIMINE_FRAMEBUFFER_REQUEST,
     .revision = 0};
 
-// // Halt and catch fire function.
-// i dont know why this cant be somewhere else, it just doesnt work for whatever reason
-static void hcf(void)
+static inline void cpu_halt(void)
 {
-    for (;;)
-    {
 #if defined(__x86_64__)
-        asm("hlt");
+    asm("hlt");
 #elif defined(__aarch64__) || defined(__riscv)
-        asm("wfi");
+    asm("wfi");
 #elif defined(__loongarch64)
-        asm("idle 0");
+    asm("idle 0");
 #endif
+}
+
+// Halt and catch fire: stop this CPU for good. For boot failures, so it
+// touches nothing that may not be set up yet.
+static void hcf(void)
+{
+    irq_save();
+    for (;;)
+        cpu_halt();
+}
+
+// Where every CPU ends up once the kernel is up: print what was logged
+// with klog(), push out pending output and initialize one more batch of
+// the memory held back at boot. Only halt once there is no such work left.
+static void idle_loop(void)
+{
+    static bool deferred_done;
+
+    for (;;)
+    {
+        while (klog_drain(KLOG_RING_RECORDS))
+            ;
+        console_flush();
+        serial_flush();
+        if (pmm_deferred_init_step(IDLE_DEFER_BATCH))
+            continue;
+        if (!__atomic_exchange_n(&deferred_done, true, __ATOMIC_RELAXED))
+        {
+            klog("pmm: deferred init done %llu ticks after entry\n",
+                 (unsigned long long)(cpu_timestamp() - boot_kmain_ticks));
+            continue;
+        }
+        cpu_halt();
     }
 }
 
@@ -86,13 +156,29 @@ static void hcf(void)
 // linker script accordingly.
 void kmain(void)
 {
+    // Before anything that calls cpu_id().
+    smp_init_bsp();
+    boot_kmain_ticks = cpu_timestamp();
+
     // Ensure the bootloader actually understands our base revision (see spec).
     if (LIMINE_BASE_REVISION_SUPPORTED == false)
     {
         hcf();
     }
 
+    // Needs nothing else, so output can start before the console is up.
+    serial_init();
     pmm_init_after_kernel();
+    if (ALLOCTRACE_BOOT_PAGES)
+    {
+        // Straight from the PMM: the ring must not live in the heap it traces.
+        uintptr_t trace = pmm_alloc_pages(ALLOCTRACE_BOOT_PAGES);
+        if (trace)
+            alloctrace_start(phys_to_virt(trace), ALLOCTRACE_BOOT_PAGES * PAGE_SIZE);
+    }
+    kmem_init();
+    boot_ready_ticks = cpu_timestamp();
+    klog("kmain: memory up %llu ticks after entry\n", (unsigned long long)(boot_ready_ticks - boot_kmain_ticks));
     // Ensure we got a framebuffer.
     if (framebuffer_request.response == NULL || framebuffer_request.response->framebuffer_count < 1)
     {
@@ -102,11 +188,27 @@ void kmain(void)
     struct limine_framebuffer *framebuffer = framebuffer_request.response->framebuffers[0];
 
     // Note: we assume the framebuffer model is RGB with 32-bit pixels.
-    for (size_t i = 0; i < 100; i++)
+    if (!fb_init(framebuffer) || !console_init())
+    {
+        hcf();
+    }
+
+    // The other CPUs go straight to idle_loop().
+    unsigned int cpus = smp_init(idle_loop);
+
+    struct pmm_stats mem;
+    pmm_get_stats(&mem);
+    kprintf("kernel: %ux%u console%s, %u CPU(s), %zu MiB usable memory on %u node(s)\n",
+            console_cols(), console_rows(), fb_write_combining() ? " (write-combining)" : "",
+            cpus, mem.usable_pages * PAGE_SIZE >> 20, mem.nodes);
+    // We're done. Idle: idle_loop() finishes initializing the memory held
+    // back at boot a batch per pass, prints the log, then hangs...
+    if (ALLOCTRACE_BOOT_PAGES)
     {
-        volatile uint32_t *fb_ptr = framebuffer->address;
-        fb_ptr[(framebuffer->pitch / 4) + i] = 0xffffff;
+        // Hand the boot trace to the host: save the serial log and feed it
+        // to bench/trace_replay.
+        alloctrace_stop();
+        alloctrace_dump(serial_write);
     }
-    // We're done, just hang...
-    hcf();
+    idle_loop();
 }
\ No newline at end of file
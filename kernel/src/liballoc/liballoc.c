@@ -1,19 +1,58 @@
 #include <kernel/liballoc/liballoc.h>
 
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include <kernel/alloctrace/alloctrace.h>
+#include <kernel/slab/slab.h>
+
 /**  Durand's Ridiculously Amazing Super Duper Memory functions.  */
 
+/* Requests up to KMEM_MAX_SIZE bytes are served by the slab size classes
+   (kmem_alloc), which need no boundary tag per object. Requests above
+   LIBALLOC_LARGE get a page run of their own straight from liballoc_alloc,
+   marked by a tag with LIBALLOC_LARGE_MAGIC, and free() hands the pages
+   back at once. Everything in between, and everything before the slab
+   layer is up, goes through the tags below.
+
+   Aligned requests take the slab classes up to a cache line. From a page
+   up they get pages of their own from liballoc_alloc_aligned, which leaves
+   no room for a tag, so those are found through a small hash keyed by
+   address. Anything else over-allocates from the tags and puts a tag with
+   LIBALLOC_ALIGNED_MAGIC just in front of the aligned pointer, whose
+   real_size is the distance back to the pointer malloc() returned. */
+
 // #define DEBUG
 
 #define LIBALLOC_MAGIC 0xc001c0de
+#define LIBALLOC_LARGE_MAGIC 0xc001b16e
+#define LIBALLOC_ALIGNED_MAGIC 0xc001a119
+#define LIBALLOC_LARGE (256 * 1024)
+#define LIBALLOC_ALIGN 16 //< Every tag, and so every pointer, is this aligned.
 #define MAXCOMPLETE 5
-#define MAXEXP 32
+#define MAXEXP LIBALLOC_MAXEXP
 #define MINEXP 8
+#define ALIGNED_BUCKETS 64
+
+#ifndef EINVAL
+#define EINVAL 22
+#endif
+#ifndef ENOMEM
+#define ENOMEM 12
+#endif
 
 #define MODE_BEST 0
 #define MODE_INSTANT 1
 
 #define MODE MODE_BEST
 
+/* Record every call in the allocation trace while alloctrace is on. Build
+   with -DLIBALLOC_TRACE=0 to leave the hooks out altogether. */
+#ifndef LIBALLOC_TRACE
+#define LIBALLOC_TRACE 1
+#endif
+
 #ifdef DEBUG
 #include <stdio.h>
 #endif
@@ -21,14 +60,26 @@
 struct boundary_tag *l_freePages[MAXEXP]; //< Allowing for 2^MAXEXP blocks
 int l_completePages[MAXEXP];              //< Allowing for 2^MAXEXP blocks
 
-#ifdef DEBUG
-unsigned int l_allocated = 0; //< The real amount of memory allocated.
-unsigned int l_inuse = 0;     //< The amount of memory in use (malloc'ed).
-#endif
+/** Pages from liballoc_alloc_aligned, hashed by address. */
+struct aligned_block
+{
+  void *ptr;
+  size_t size;
+  size_t pages;
+  struct aligned_block *next;
+};
+
+static struct aligned_block *l_alignedBlocks[ALIGNED_BUCKETS];
+
+static struct heap_stats l_stats; //< Always-on counters, see heap_stats().
+
+// Counters are also bumped outside the lock on the large-object path.
+#define STAT_ADD(field, n) __atomic_fetch_add(&l_stats.field, (n), __ATOMIC_RELAXED)
+#define STAT_SUB(field, n) __atomic_fetch_sub(&l_stats.field, (n), __ATOMIC_RELAXED)
 
 static int l_initialized = 0; //< Flag to indicate initialization.
-static int l_pageSize = 4096; //< Individual page size
-static int l_pageCount = 16;  //< Minimum number of pages to allocate.
+static size_t l_pageSize = 4096; //< Individual page size
+static size_t l_pageCount = 16;  //< Minimum number of pages to allocate.
 
 // ***********   HELPER FUNCTIONS  *******************************
 
@@ -36,12 +87,12 @@ static int l_pageCount = 16;  //< Minimum number of pages to allocate.
  *
  *  Returns n where  2^n <= size < 2^(n+1)
  */
-static inline int getexp(unsigned int size)
+static inline int getexp(size_t size)
 {
-  if (size < (1 << MINEXP))
+  if (size < ((size_t)1 << MINEXP))
   {
 #ifdef DEBUG
-    printf("getexp returns -1 for %i less than MINEXP\n", size);
+    printf("getexp returns -1 for %zu less than MINEXP\n", size);
 #endif
     return -1; // Smaller than the quantum.
   }
@@ -50,50 +101,41 @@ static inline int getexp(unsigned int size)
 
   while (shift < MAXEXP)
   {
-    if ((1 << shift) > size)
+    if (((size_t)1 << shift) > size)
       break;
     shift += 1;
   }
 
 #ifdef DEBUG
-  printf("getexp returns %i (%i bytes) for %i size\n", shift - 1, (1 << (shift - 1)), size);
+  printf("getexp returns %i (%zu bytes) for %zu size\n", shift - 1, ((size_t)1 << (shift - 1)), size);
 #endif
 
   return shift - 1;
 }
 
-static void *liballoc_memset(void *s, int c, size_t n)
+/** Raise a peak counter to `now` if it is higher. */
+static inline void stat_peak(size_t *peak, size_t now)
 {
-  int i;
-  for (i = 0; i < n; i++)
-    ((char *)s)[i] = c;
-
-  return s;
+  size_t old = __atomic_load_n(peak, __ATOMIC_RELAXED);
+  while ((now > old) && !__atomic_compare_exchange_n(peak, &old, now, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+    ;
 }
 
-static void *liballoc_memcpy(void *s1, const void *s2, size_t n)
+static inline void stat_in_use(size_t bytes)
 {
-  char *cdest;
-  char *csrc;
-  unsigned int *ldest = (unsigned int *)s1;
-  unsigned int *lsrc = (unsigned int *)s2;
-
-  while (n >= sizeof(unsigned int))
-  {
-    *ldest++ = *lsrc++;
-    n -= sizeof(unsigned int);
-  }
-
-  cdest = (char *)ldest;
-  csrc = (char *)lsrc;
+  stat_peak(&l_stats.peak_in_use, STAT_ADD(bytes_in_use, bytes) + bytes);
+}
 
-  while (n > 0)
-  {
-    *cdest++ = *csrc++;
-    n -= 1;
-  }
+static inline void stat_pages_taken(size_t pages)
+{
+  STAT_ADD(pages_taken, pages);
+  stat_peak(&l_stats.peak_reserved, STAT_ADD(bytes_reserved, pages * l_pageSize) + pages * l_pageSize);
+}
 
-  return s1;
+static inline void stat_pages_returned(size_t pages)
+{
+  STAT_ADD(pages_returned, pages);
+  STAT_SUB(bytes_reserved, pages * l_pageSize);
 }
 
 #ifdef DEBUG
@@ -103,8 +145,8 @@ static void dump_array()
   struct boundary_tag *tag = NULL;
 
   printf("------ Free pages array ---------\n");
-  printf("System memory allocated: %i\n", l_allocated);
-  printf("Memory in used (malloc'ed): %i\n", l_inuse);
+  printf("System memory allocated: %zu\n", l_stats.bytes_reserved);
+  printf("Memory in used (malloc'ed): %zu\n", l_stats.bytes_in_use);
 
   for (i = 0; i < MAXEXP; i++)
   {
@@ -115,7 +157,7 @@ static void dump_array()
     {
       if (tag->split_left != NULL)
         printf("*");
-      printf("%i", tag->real_size);
+      printf("%zu", tag->real_size);
       if (tag->split_right != NULL)
         printf("*");
 
@@ -175,6 +217,7 @@ static inline struct boundary_tag *melt_left(struct boundary_tag *tag)
 
   left->real_size += tag->real_size;
   left->split_right = tag->split_right;
+  l_stats.melts++;
 
   if (tag->split_right != NULL)
     tag->split_right->split_left = left;
@@ -189,6 +232,7 @@ static inline struct boundary_tag *absorb_right(struct boundary_tag *tag)
   remove_tag(right); // Remove right from free pages.
 
   tag->real_size += right->real_size;
+  l_stats.melts++;
 
   tag->split_right = right->split_right;
   if (right->split_right != NULL)
@@ -197,15 +241,23 @@ static inline struct boundary_tag *absorb_right(struct boundary_tag *tag)
   return tag;
 }
 
+/** Bytes a tag's data really occupies: its size rounded up so the next
+ * tag stays LIBALLOC_ALIGN aligned. */
+static inline size_t tag_span(size_t size)
+{
+  return (size + LIBALLOC_ALIGN - 1) & ~(size_t)(LIBALLOC_ALIGN - 1);
+}
+
 static inline struct boundary_tag *split_tag(struct boundary_tag *tag)
 {
-  unsigned int remainder = tag->real_size - sizeof(struct boundary_tag) - tag->size;
+  size_t remainder = tag->real_size - sizeof(struct boundary_tag) - tag_span(tag->size);
 
   struct boundary_tag *new_tag =
-      (struct boundary_tag *)((unsigned int)tag + sizeof(struct boundary_tag) + tag->size);
+      (struct boundary_tag *)((uintptr_t)tag + sizeof(struct boundary_tag) + tag_span(tag->size));
 
   new_tag->magic = LIBALLOC_MAGIC;
   new_tag->real_size = remainder;
+  l_stats.splits++;
 
   new_tag->next = NULL;
   new_tag->prev = NULL;
@@ -224,12 +276,72 @@ static inline struct boundary_tag *split_tag(struct boundary_tag *tag)
   return new_tag;
 }
 
+/** Split the space beyond tag->size off into a free tag of its own if it is
+ * worth keeping. Returns the new tag, or NULL if nothing was split.
+ */
+static inline struct boundary_tag *trim_tag(struct boundary_tag *tag)
+{
+  struct boundary_tag *new_tag = NULL;
+
+  // Support a new tag + remainder
+  if (tag->real_size > tag_span(tag->size) + sizeof(struct boundary_tag) * 2)
+  {
+    size_t remainder = tag->real_size - tag_span(tag->size) - sizeof(struct boundary_tag) * 2;
+    int childIndex = getexp(remainder);
+
+    if (childIndex >= 0)
+    {
+#ifdef DEBUG
+      printf("Seems to be splittable: %zu >= 2^%i .. %zu\n", remainder, childIndex, ((size_t)1 << childIndex));
+#endif
+
+      new_tag = split_tag(tag);
+
+#ifdef DEBUG
+      printf("Old tag has become %zu bytes, new tag is now %zu bytes (%i exp)\n", tag->real_size, new_tag->real_size, new_tag->index);
+#endif
+    }
+  }
+
+  return new_tag;
+}
+
+/** Resize an allocated tag where it stands: shrinking splits off the tail,
+ * growing absorbs a free right neighbour. Returns 0 if the allocation has
+ * to move instead.
+ */
+static int resize_tag(struct boundary_tag *tag, size_t size)
+{
+  struct boundary_tag *right = tag->split_right;
+  size_t room = tag->real_size - sizeof(struct boundary_tag);
+
+  if (size > room)
+  {
+    if ((right == NULL) || (right->index < 0) || (room + right->real_size < size))
+      return 0;
+    absorb_right(tag);
+  }
+
+  tag->size = size;
+
+  // The split-off tail may now border a free tag; melt the two.
+  struct boundary_tag *rest = trim_tag(tag);
+  if ((rest != NULL) && (rest->split_right != NULL) && (rest->split_right->index >= 0))
+  {
+    remove_tag(rest);
+    absorb_right(rest);
+    insert_tag(rest, -1);
+  }
+
+  return 1;
+}
+
 // ***************************************************************
 
-static struct boundary_tag *allocate_new_tag(unsigned int size)
+static struct boundary_tag *allocate_new_tag(size_t size)
 {
-  unsigned int pages;
-  unsigned int usage;
+  size_t pages;
+  size_t usage;
   struct boundary_tag *tag;
 
   // This is how much space is required.
@@ -259,23 +371,189 @@ static struct boundary_tag *allocate_new_tag(unsigned int size)
   tag->split_left = NULL;
   tag->split_right = NULL;
 
-#ifdef DEBUG
-  printf("Resource allocated %x of %i pages (%i bytes) for %i size.\n", tag, pages, pages * l_pageSize, size);
-
-  l_allocated += pages * l_pageSize;
+  stat_pages_taken(pages);
 
-  printf("Total memory usage = %i KB\n", (int)((l_allocated / (1024))));
+#ifdef DEBUG
+  printf("Resource allocated %p of %zu pages (%zu bytes) for %zu size.\n", tag, pages, pages * l_pageSize, size);
+  printf("Total memory usage = %zu KB\n", l_stats.bytes_reserved / 1024);
 #endif
 
   return tag;
 }
 
-void *malloc(size_t size)
+/** Large objects: a page run per allocation with a tag in front. */
+static void *allocate_large(size_t size)
+{
+  if (size > (size_t)-1 - sizeof(struct boundary_tag) - l_pageSize)
+    return NULL;
+
+  size_t pages = (size + sizeof(struct boundary_tag) + l_pageSize - 1) / l_pageSize;
+  struct boundary_tag *tag = (struct boundary_tag *)liballoc_alloc(pages);
+  if (tag == NULL)
+    return NULL;
+
+  tag->magic = LIBALLOC_LARGE_MAGIC;
+  tag->size = size;
+  tag->real_size = pages * l_pageSize;
+  tag->index = -1;
+  tag->next = NULL;
+  tag->prev = NULL;
+  tag->split_left = NULL;
+  tag->split_right = NULL;
+
+  stat_pages_taken(pages);
+  stat_in_use(size);
+  STAT_ADD(allocs, 1);
+  STAT_ADD(large_allocs, 1);
+
+  return (void *)((uintptr_t)tag + sizeof(struct boundary_tag));
+}
+
+static void free_large(struct boundary_tag *tag)
+{
+  size_t pages = tag->real_size / l_pageSize;
+
+  STAT_SUB(bytes_in_use, tag->size);
+  STAT_ADD(frees, 1);
+  STAT_ADD(large_frees, 1);
+  stat_pages_returned(pages);
+
+  tag->magic = 0;
+  liballoc_free(tag, pages);
+}
+
+static inline struct aligned_block **aligned_bucket(const void *ptr)
+{
+  return &l_alignedBlocks[((uintptr_t)ptr / l_pageSize) % ALIGNED_BUCKETS];
+}
+
+/** Finds the block for `ptr` among the page-aligned allocations. Takes the
+ * lock, so only pointers at the start of a page are worth asking about.
+ * With `unlink` set the block is removed from the hash.
+ */
+static struct aligned_block *find_aligned(const void *ptr, int unlink)
+{
+  struct aligned_block **link;
+  struct aligned_block *block;
+
+  if (((uintptr_t)ptr & (l_pageSize - 1)) != 0)
+    return NULL;
+
+  liballoc_lock();
+  for (link = aligned_bucket(ptr); (block = *link) != NULL; link = &block->next)
+  {
+    if (block->ptr == ptr)
+    {
+      if (unlink)
+        *link = block->next;
+      break;
+    }
+  }
+  liballoc_unlock();
+  return block;
+}
+
+/** Page alignments and up: pages of their own, tracked off to the side. */
+static void *allocate_aligned_pages(size_t size, size_t align)
+{
+  struct aligned_block *block;
+  size_t pages;
+
+  if (size > (size_t)-1 - l_pageSize)
+    return NULL;
+  pages = (size + l_pageSize - 1) / l_pageSize;
+  if (pages == 0)
+    pages = 1;
+
+  block = (struct aligned_block *)kmem_alloc(sizeof(struct aligned_block));
+  if (block == NULL)
+    return NULL;
+
+  block->ptr = liballoc_alloc_aligned(pages, align);
+  if (block->ptr == NULL)
+  {
+    kmem_free(block);
+    return NULL;
+  }
+  block->size = size;
+  block->pages = pages;
+
+  liballoc_lock();
+  block->next = *aligned_bucket(block->ptr);
+  *aligned_bucket(block->ptr) = block;
+  liballoc_unlock();
+
+  stat_pages_taken(pages);
+  stat_in_use(size);
+  STAT_ADD(allocs, 1);
+  STAT_ADD(large_allocs, 1);
+
+  return block->ptr;
+}
+
+static void free_aligned_pages(struct aligned_block *block)
+{
+  STAT_SUB(bytes_in_use, block->size);
+  STAT_ADD(frees, 1);
+  STAT_ADD(large_frees, 1);
+  stat_pages_returned(block->pages);
+
+  liballoc_free(block->ptr, block->pages);
+  kmem_free(block);
+}
+
+static void *heap_alloc(size_t size);
+
+/** Over-allocates from the tags and marks the aligned pointer inside. Slab
+ * objects are skipped: kmem_free() would take the inner pointer for one.
+ */
+static void *allocate_offset(size_t size, size_t align)
+{
+  struct boundary_tag *tag;
+  uintptr_t base, ptr;
+
+  if (size > (size_t)-1 - align - sizeof(struct boundary_tag))
+    return NULL;
+
+  base = (uintptr_t)heap_alloc(size + align + sizeof(struct boundary_tag));
+  if (base == 0)
+    return NULL;
+
+  ptr = (base + sizeof(struct boundary_tag) + align - 1) & ~(uintptr_t)(align - 1);
+  tag = (struct boundary_tag *)(ptr - sizeof(struct boundary_tag));
+  tag->magic = LIBALLOC_ALIGNED_MAGIC;
+  tag->size = size;
+  tag->real_size = ptr - base;
+  tag->index = -1;
+  tag->next = NULL;
+  tag->prev = NULL;
+  tag->split_left = NULL;
+  tag->split_right = NULL;
+
+  return (void *)ptr;
+}
+
+/* The entry points below are wrapped by traced versions at the end of the
+   file; internally liballoc calls these so nothing is recorded twice. */
+static void *malloc_untraced(size_t size)
+{
+  void *ptr;
+
+  if (size <= KMEM_MAX_SIZE && (ptr = kmem_alloc(size)) != NULL)
+    return ptr;
+  return heap_alloc(size);
+}
+
+/** malloc() without the slab size classes. */
+static void *heap_alloc(size_t size)
 {
   int index;
   void *ptr;
   struct boundary_tag *tag = NULL;
 
+  if (size > LIBALLOC_LARGE)
+    return allocate_large(size);
+
   liballoc_lock();
 
   if (l_initialized == 0)
@@ -295,6 +573,8 @@ void *malloc(size_t size)
   if (index < MINEXP)
     index = MINEXP;
 
+  l_stats.allocs_by_exp[index]++;
+
   // Find one big enough.
   tag = l_freePages[index]; // Start at the front of the list.
   while (tag != NULL)
@@ -303,7 +583,7 @@ void *malloc(size_t size)
     if ((tag->real_size - sizeof(struct boundary_tag)) >= (size + sizeof(struct boundary_tag)))
     {
 #ifdef DEBUG
-      printf("Tag search found %i >= %i\n", (tag->real_size - sizeof(struct boundary_tag)), (size + sizeof(struct boundary_tag)));
+      printf("Tag search found %zu >= %zu\n", (tag->real_size - sizeof(struct boundary_tag)), (size + sizeof(struct boundary_tag)));
 #endif
       break;
     }
@@ -337,36 +617,18 @@ void *malloc(size_t size)
   // Removed... see if we can re-use the excess space.
 
 #ifdef DEBUG
-  printf("Found tag with %i bytes available (requested %i bytes, leaving %i), which has exponent: %i (%i bytes)\n", tag->real_size - sizeof(struct boundary_tag), size, tag->real_size - size - sizeof(struct boundary_tag), index, 1 << index);
-#endif
-
-  unsigned int remainder = tag->real_size - size - sizeof(struct boundary_tag) * 2; // Support a new tag + remainder
-
-  if (((int)(remainder) > 0) /*&& ( (tag->real_size - remainder) >= (1<<MINEXP))*/)
-  {
-    int childIndex = getexp(remainder);
-
-    if (childIndex >= 0)
-    {
-#ifdef DEBUG
-      printf("Seems to be splittable: %i >= 2^%i .. %i\n", remainder, childIndex, (1 << childIndex));
+  printf("Found tag with %zu bytes available (requested %zu bytes, leaving %zu), which has exponent: %i (%zu bytes)\n", tag->real_size - sizeof(struct boundary_tag), size, tag->real_size - size - sizeof(struct boundary_tag), index, (size_t)1 << index);
 #endif
 
-      struct boundary_tag *new_tag = split_tag(tag);
-
-      new_tag = new_tag; // Get around the compiler warning about unused variables.
+  trim_tag(tag);
 
-#ifdef DEBUG
-      printf("Old tag has become %i bytes, new tag is now %i bytes (%i exp)\n", tag->real_size, new_tag->real_size, new_tag->index);
-#endif
-    }
-  }
+  ptr = (void *)((uintptr_t)tag + sizeof(struct boundary_tag));
 
-  ptr = (void *)((unsigned int)tag + sizeof(struct boundary_tag));
+  stat_in_use(size);
+  STAT_ADD(allocs, 1);
 
 #ifdef DEBUG
-  l_inuse += size;
-  printf("malloc: %x,  %i, %i\n", ptr, (int)l_inuse / 1024, (int)l_allocated / 1024);
+  printf("malloc: %p,  %zu, %zu\n", ptr, l_stats.bytes_in_use / 1024, l_stats.bytes_reserved / 1024);
   dump_array();
 #endif
 
@@ -374,17 +636,43 @@ void *malloc(size_t size)
   return ptr;
 }
 
-void free(void *ptr)
+static void free_untraced(void *ptr)
 {
   int index;
   struct boundary_tag *tag;
+  struct aligned_block *block;
 
   if (ptr == NULL)
     return;
 
-  liballoc_lock();
+  if (kmem_free(ptr))
+    return;
+
+  // Checked before looking for a tag: the bytes in front of these pages
+  // belong to someone else.
+  if ((block = find_aligned(ptr, 1)) != NULL)
+  {
+    free_aligned_pages(block);
+    return;
+  }
+
+  tag = (struct boundary_tag *)((uintptr_t)ptr - sizeof(struct boundary_tag));
+
+  if (tag->magic == LIBALLOC_ALIGNED_MAGIC)
+  {
+    tag->magic = 0;
+    free_untraced((void *)((uintptr_t)ptr - tag->real_size));
+    return;
+  }
+
+  // Large objects own their pages outright; no lists to update.
+  if (tag->magic == LIBALLOC_LARGE_MAGIC)
+  {
+    free_large(tag);
+    return;
+  }
 
-  tag = (struct boundary_tag *)((unsigned int)ptr - sizeof(struct boundary_tag));
+  liballoc_lock();
 
   if (tag->magic != LIBALLOC_MAGIC)
   {
@@ -392,16 +680,18 @@ void free(void *ptr)
     return;
   }
 
+  STAT_SUB(bytes_in_use, tag->size);
+  STAT_ADD(frees, 1);
+
 #ifdef DEBUG
-  l_inuse -= tag->size;
-  printf("free: %x, %i, %i\n", ptr, (int)l_inuse / 1024, (int)l_allocated / 1024);
+  printf("free: %p, %zu, %zu\n", ptr, l_stats.bytes_in_use / 1024, l_stats.bytes_reserved / 1024);
 #endif
 
   // MELT LEFT...
   while ((tag->split_left != NULL) && (tag->split_left->index >= 0))
   {
 #ifdef DEBUG
-    printf("Melting tag left into available memory. Left was %i, becomes %i (%i)\n", tag->split_left->real_size, tag->split_left->real_size + tag->real_size, tag->split_left->real_size);
+    printf("Melting tag left into available memory. Left was %zu, becomes %zu (%zu)\n", tag->split_left->real_size, tag->split_left->real_size + tag->real_size, tag->split_left->real_size);
 #endif
     tag = melt_left(tag);
     remove_tag(tag);
@@ -411,7 +701,7 @@ void free(void *ptr)
   while ((tag->split_right != NULL) && (tag->split_right->index >= 0))
   {
 #ifdef DEBUG
-    printf("Melting tag right into available memory. This was was %i, becomes %i (%i)\n", tag->real_size, tag->split_right->real_size + tag->real_size, tag->split_right->real_size);
+    printf("Melting tag right into available memory. This was was %zu, becomes %zu (%zu)\n", tag->real_size, tag->split_right->real_size + tag->real_size, tag->split_right->real_size);
 #endif
     tag = absorb_right(tag);
   }
@@ -428,7 +718,7 @@ void free(void *ptr)
     if (l_completePages[index] == MAXCOMPLETE)
     {
       // Too many standing by to keep. Free this one.
-      unsigned int pages = tag->real_size / l_pageSize;
+      size_t pages = tag->real_size / l_pageSize;
 
       if ((tag->real_size % l_pageSize) != 0)
         pages += 1;
@@ -436,10 +726,10 @@ void free(void *ptr)
         pages = l_pageCount;
 
       liballoc_free(tag, pages);
+      stat_pages_returned(pages);
 
 #ifdef DEBUG
-      l_allocated -= pages * l_pageSize;
-      printf("Resource freeing %x of %i pages\n", tag, pages);
+      printf("Resource freeing %p of %zu pages\n", tag, pages);
       dump_array();
 #endif
 
@@ -455,7 +745,7 @@ void free(void *ptr)
   insert_tag(tag, index);
 
 #ifdef DEBUG
-  printf("Returning tag with %i bytes (requested %i bytes), which has exponent: %i\n", tag->real_size, tag->size, index);
+  printf("Returning tag with %zu bytes (requested %zu bytes), which has exponent: %i\n", tag->real_size, tag->size, index);
   dump_array();
 #endif
 
@@ -464,45 +754,224 @@ void free(void *ptr)
 
 void *calloc(size_t nobj, size_t size)
 {
-  int real_size;
+  size_t real_size;
   void *p;
 
+  if (size != 0 && nobj > (size_t)-1 / size)
+    return NULL;
   real_size = nobj * size;
 
-  p = malloc(real_size);
+  uint64_t start = LIBALLOC_TRACE ? alloctrace_begin() : 0;
+  p = malloc_untraced(real_size);
 
-  liballoc_memset(p, 0, real_size);
+  if (p != NULL)
+    memset(p, 0, real_size);
 
+  if (LIBALLOC_TRACE)
+    alloctrace_end(ALLOCTRACE_CALLOC, start, real_size, p, NULL, 0);
   return p;
 }
 
-void *realloc(void *p, size_t size)
+static void *realloc_untraced(void *p, size_t size)
 {
   void *ptr;
   struct boundary_tag *tag;
-  int real_size;
+  struct aligned_block *block;
+  size_t real_size;
 
   if (size == 0)
   {
-    free(p);
+    free_untraced(p);
     return NULL;
   }
   if (p == NULL)
-    return malloc(size);
+    return malloc_untraced(size);
+
+  real_size = kmem_size(p);
+  if (real_size >= size)
+    return p; // still fits its size class
+
+  // Aligned blocks are never resized in place: realloc() owes them no
+  // alignment, so they move to a plain allocation.
+  if ((real_size == 0) && ((block = find_aligned(p, 0)) != NULL))
+    real_size = block->size;
+  else if (real_size == 0)
+  {
+    tag = (struct boundary_tag *)((uintptr_t)p - sizeof(struct boundary_tag));
+    real_size = tag->real_size - sizeof(struct boundary_tag);
 
-  if (liballoc_lock != NULL)
-    liballoc_lock(); // lockit
-  tag = (struct boundary_tag *)((unsigned int)p - sizeof(struct boundary_tag));
-  real_size = tag->size;
-  if (liballoc_unlock != NULL)
-    liballoc_unlock();
+    if (tag->magic == LIBALLOC_ALIGNED_MAGIC)
+      real_size = tag->size;
+    else if (tag->magic == LIBALLOC_LARGE_MAGIC)
+    {
+      // Use the slack in the last page, but move once it is no longer
+      // large so the pages go back.
+      if ((size <= real_size) && (size > LIBALLOC_LARGE))
+      {
+        if (size > tag->size)
+          stat_in_use(size - tag->size);
+        else
+          STAT_SUB(bytes_in_use, tag->size - size);
+        tag->size = size;
+
+        // Shrunk by a page or more: give the pages past the end back.
+        size_t have = tag->real_size / l_pageSize;
+        size_t keep = (size + sizeof(struct boundary_tag) + l_pageSize - 1) / l_pageSize;
+        if (keep < have)
+        {
+          liballoc_free((void *)((uintptr_t)tag + keep * l_pageSize), have - keep);
+          tag->real_size = keep * l_pageSize;
+          stat_pages_returned(have - keep);
+        }
+        STAT_ADD(realloc_in_place, 1);
+        return p;
+      }
+    }
+    else
+    {
+      liballoc_lock(); // lockit
+      size_t old_size = tag->size;
+      if (resize_tag(tag, size))
+      {
+        if (size > old_size)
+          stat_in_use(size - old_size);
+        else
+          STAT_SUB(bytes_in_use, old_size - size);
+        STAT_ADD(realloc_in_place, 1);
+        liballoc_unlock();
+        return p;
+      }
+      liballoc_unlock();
+    }
+  }
 
   if (real_size > size)
     real_size = size;
 
-  ptr = malloc(size);
-  liballoc_memcpy(ptr, p, real_size);
-  free(p);
+  ptr = malloc_untraced(size);
+  if (ptr == NULL)
+    return NULL;
+  memcpy(ptr, p, real_size);
+  free_untraced(p);
+  STAT_ADD(realloc_moved, 1);
+
+  return ptr;
+}
+
+size_t malloc_usable_size(void *ptr)
+{
+  struct boundary_tag *tag;
+  struct aligned_block *block;
+  size_t size;
+
+  if (ptr == NULL)
+    return 0;
+
+  size = kmem_size(ptr);
+  if (size != 0)
+    return size;
+
+  if ((block = find_aligned(ptr, 0)) != NULL)
+    return block->pages * l_pageSize;
+
+  tag = (struct boundary_tag *)((uintptr_t)ptr - sizeof(struct boundary_tag));
+  if (tag->magic == LIBALLOC_ALIGNED_MAGIC)
+    return malloc_usable_size((void *)((uintptr_t)ptr - tag->real_size)) - tag->real_size;
+  if ((tag->magic != LIBALLOC_MAGIC) && (tag->magic != LIBALLOC_LARGE_MAGIC))
+    return 0;
+
+  return tag->real_size - sizeof(struct boundary_tag);
+}
+
+static void *kmalloc_aligned_untraced(size_t size, size_t align)
+{
+  void *ptr;
+
+  if ((align == 0) || ((align & (align - 1)) != 0))
+    return NULL;
+  if (align <= LIBALLOC_ALIGN)
+    return malloc_untraced(size);
+
+  if ((size <= KMEM_MAX_SIZE) && ((ptr = kmem_alloc_aligned(size, align)) != NULL))
+    return ptr;
+  if ((align >= l_pageSize) && ((ptr = allocate_aligned_pages(size, align)) != NULL))
+    return ptr;
+
+  return allocate_offset(size, align);
+}
+
+void *malloc(size_t size)
+{
+  uint64_t start = LIBALLOC_TRACE ? alloctrace_begin() : 0;
+  void *ptr = malloc_untraced(size);
+  if (LIBALLOC_TRACE)
+    alloctrace_end(ALLOCTRACE_MALLOC, start, size, ptr, NULL, 0);
+  return ptr;
+}
+
+void free(void *ptr)
+{
+  uint64_t start = LIBALLOC_TRACE ? alloctrace_begin() : 0;
+  free_untraced(ptr);
+  if (LIBALLOC_TRACE && ptr != NULL)
+    alloctrace_end(ALLOCTRACE_FREE, start, 0, ptr, NULL, 0);
+}
+
+void *realloc(void *p, size_t size)
+{
+  uint64_t start = LIBALLOC_TRACE ? alloctrace_begin() : 0;
+  void *ptr = realloc_untraced(p, size);
+  if (LIBALLOC_TRACE)
+    alloctrace_end(ALLOCTRACE_REALLOC, start, size, ptr, p, 0);
+  return ptr;
+}
 
+void *kmalloc_aligned(size_t size, size_t align)
+{
+  uint64_t start = LIBALLOC_TRACE ? alloctrace_begin() : 0;
+  void *ptr = kmalloc_aligned_untraced(size, align);
+  if (LIBALLOC_TRACE)
+    alloctrace_end(ALLOCTRACE_ALIGNED, start, size, ptr, NULL, align);
   return ptr;
-}
\ No newline at end of file
+}
+
+void *aligned_alloc(size_t align, size_t size)
+{
+  return kmalloc_aligned(size, align);
+}
+
+int posix_memalign(void **memptr, size_t align, size_t size)
+{
+  void *ptr;
+
+  if ((align < sizeof(void *)) || ((align & (align - 1)) != 0))
+    return EINVAL;
+
+  ptr = kmalloc_aligned(size, align);
+  if (ptr == NULL)
+    return ENOMEM;
+
+  *memptr = ptr;
+  return 0;
+}
+
+void heap_stats(struct heap_stats *out)
+{
+  int i;
+
+  liballoc_lock();
+  *out = l_stats;
+  for (i = 0; i < MAXEXP; i++)
+  {
+    size_t count = 0;
+    struct boundary_tag *tag;
+    for (tag = l_freePages[i]; tag != NULL; tag = tag->next)
+      count++;
+    out->free_tags[i] = count;
+    out->complete_pages[i] = l_completePages[i];
+  }
+  liballoc_unlock();
+
+  kmem_class_usage(&out->slab_bytes_in_use, &out->slab_bytes_reserved);
+  kmem_cpu_stats(&out->slab_cpu_hits, &out->slab_cpu_misses);
+}
@@ -0,0 +1,217 @@
+#include <kernel/numa/numa.h>
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include <kernel/acpi/acpi.h>
+#include <kernel/pmm/pmm.h>
+
+#define NUMA_MAX_RANGES 32
+
+/* SRAT structure types */
+#define SRAT_LAPIC_AFFINITY 0
+#define SRAT_MEMORY_AFFINITY 1
+#define SRAT_X2APIC_AFFINITY 2
+#define SRAT_ENABLED (1u << 0)
+
+struct srat_lapic
+{
+  uint8_t type;
+  uint8_t length;
+  uint8_t domain_lo;
+  uint8_t apic_id;
+  uint32_t flags;
+  uint8_t sapic_eid;
+  uint8_t domain_hi[3];
+  uint32_t clock_domain;
+} __attribute__((packed));
+
+struct srat_memory
+{
+  uint8_t type;
+  uint8_t length;
+  uint32_t domain;
+  uint16_t reserved0;
+  uint64_t base;
+  uint64_t size;
+  uint32_t reserved1;
+  uint32_t flags;
+  uint64_t reserved2;
+} __attribute__((packed));
+
+struct srat_x2apic
+{
+  uint8_t type;
+  uint8_t length;
+  uint16_t reserved0;
+  uint32_t domain;
+  uint32_t x2apic_id;
+  uint32_t flags;
+  uint32_t clock_domain;
+  uint32_t reserved1;
+} __attribute__((packed));
+
+/* Memory ranges by node, sorted by start page and non-overlapping. */
+static struct
+{
+  size_t start;
+  size_t end;
+  unsigned int node;
+} numa_ranges[NUMA_MAX_RANGES];
+static unsigned int numa_range_count;
+
+/* Proximity domain of each node index; domains are renumbered densely. */
+static uint32_t numa_domains[NUMA_MAX_NODES];
+static unsigned int numa_nodes = 1;
+
+static struct
+{
+  uint64_t hw_id; // (x2)APIC id from the SRAT
+  unsigned int node;
+} numa_apics[MAX_CPUS];
+static unsigned int numa_apic_count;
+
+static unsigned int numa_cpu_nodes[MAX_CPUS];
+
+static unsigned int numa_node_for_domain(uint32_t domain)
+{
+  for (unsigned int n = 0; n < numa_nodes; n++)
+  {
+    if (numa_domains[n] == domain)
+      return n;
+  }
+  if (numa_nodes == NUMA_MAX_NODES)
+    return 0; // out of node slots, fold into node 0
+  numa_domains[numa_nodes] = domain;
+  return numa_nodes++;
+}
+
+static void numa_add_range(size_t start, size_t end, unsigned int node)
+{
+  if (start >= end || numa_range_count == NUMA_MAX_RANGES)
+    return;
+
+  // Insertion sort: SRATs list a handful of ranges, usually in order already.
+  unsigned int i = numa_range_count++;
+  while (i > 0 && numa_ranges[i - 1].start > start)
+  {
+    numa_ranges[i] = numa_ranges[i - 1];
+    i--;
+  }
+  numa_ranges[i].start = start;
+  numa_ranges[i].end = end;
+  numa_ranges[i].node = node;
+}
+
+void numa_init(void)
+{
+  numa_nodes = 0;
+  numa_range_count = 0;
+  numa_apic_count = 0;
+
+  struct acpi_sdt_header *srat = acpi_find_table("SRAT");
+  if (srat)
+  {
+    // Structures start after the header and 12 reserved bytes.
+    const uint8_t *p = (const uint8_t *)srat + sizeof(struct acpi_sdt_header) + 12;
+    const uint8_t *end = (const uint8_t *)srat + srat->length;
+
+    while (p + 2 <= end && p[1] >= 2 && p + p[1] <= end)
+    {
+      if (p[0] == SRAT_MEMORY_AFFINITY && p[1] >= sizeof(struct srat_memory))
+      {
+        const struct srat_memory *m = (const struct srat_memory *)p;
+        if (m->flags & SRAT_ENABLED)
+          numa_add_range(align_up(m->base, PAGE_SIZE) / PAGE_SIZE,
+                         (m->base + m->size) / PAGE_SIZE,
+                         numa_node_for_domain(m->domain));
+      }
+      else if (p[0] == SRAT_LAPIC_AFFINITY && p[1] >= sizeof(struct srat_lapic))
+      {
+        const struct srat_lapic *l = (const struct srat_lapic *)p;
+        uint32_t domain = l->domain_lo | (uint32_t)l->domain_hi[0] << 8 |
+                          (uint32_t)l->domain_hi[1] << 16 | (uint32_t)l->domain_hi[2] << 24;
+        if ((l->flags & SRAT_ENABLED) && numa_apic_count < MAX_CPUS)
+        {
+          numa_apics[numa_apic_count].hw_id = l->apic_id;
+          numa_apics[numa_apic_count++].node = numa_node_for_domain(domain);
+        }
+      }
+      else if (p[0] == SRAT_X2APIC_AFFINITY && p[1] >= sizeof(struct srat_x2apic))
+      {
+        const struct srat_x2apic *x = (const struct srat_x2apic *)p;
+        if ((x->flags & SRAT_ENABLED) && numa_apic_count < MAX_CPUS)
+        {
+          numa_apics[numa_apic_count].hw_id = x->x2apic_id;
+          numa_apics[numa_apic_count++].node = numa_node_for_domain(x->domain);
+        }
+      }
+      p += p[1];
+    }
+  }
+
+  if (numa_nodes == 0)
+  {
+    // No SRAT: one node covering everything.
+    numa_nodes = 1;
+    numa_domains[0] = 0;
+    numa_range_count = 0;
+  }
+
+  for (unsigned int c = 0; c < MAX_CPUS; c++)
+    numa_cpu_nodes[c] = 0;
+}
+
+unsigned int numa_node_count(void)
+{
+  return numa_nodes;
+}
+
+unsigned int numa_page_node(size_t page)
+{
+  unsigned int lo = 0;
+  unsigned int hi = numa_range_count;
+  while (lo < hi)
+  {
+    unsigned int mid = (lo + hi) / 2;
+    if (page < numa_ranges[mid].start)
+      hi = mid;
+    else if (page >= numa_ranges[mid].end)
+      lo = mid + 1;
+    else
+      return numa_ranges[mid].node;
+  }
+  return 0; // not described by the SRAT
+}
+
+size_t numa_range_end(size_t page)
+{
+  for (unsigned int i = 0; i < numa_range_count; i++)
+  {
+    if (page < numa_ranges[i].start)
+      return numa_ranges[i].start;
+    if (page < numa_ranges[i].end)
+      return numa_ranges[i].end;
+  }
+  return (size_t)-1;
+}
+
+void numa_register_cpu(unsigned int cpu, uint64_t hw_id)
+{
+  if (cpu >= MAX_CPUS)
+    return;
+  for (unsigned int i = 0; i < numa_apic_count; i++)
+  {
+    if (numa_apics[i].hw_id == hw_id)
+    {
+      numa_cpu_nodes[cpu] = numa_apics[i].node;
+      return;
+    }
+  }
+}
+
+unsigned int numa_cpu_node(unsigned int cpu)
+{
+  return cpu < MAX_CPUS ? numa_cpu_nodes[cpu] : 0;
+}
@@ -6,6 +6,187 @@
 #include <string.h>
 #include <stdbool.h>
 
+#include <kernel/cpu/cpu.h>
+#include <kernel/numa/numa.h>
+#include <kernel/spinlock/spinlock.h>
+
+/* ---- PMM bitmap globals ---- */
+static uint64_t *pmm_bitmap; // virtual pointer to bitmap storage, one bit per page (1 = used)
+static size_t pmm_total_pages;
+static size_t pmm_bitmap_words;  // number of 64-bit words in the bitmap
+static size_t pmm_bitmap_bytes;  // bytes used by the bitmap, its summary layer and pmm_cached
+static uintptr_t pmm_bitmap_phys;  // physical base of bitmap
+static uintptr_t pmm_bitmap_pages; // number of pages used by bitmap
+
+/* ---- summary layer ----
+   One bit per bitmap word. pmm_summary_full has the bit set when all 64 pages
+   of the word are used, pmm_summary_free when all 64 are free. Searches use it
+   to step over whole words (and whole summary words) at once. */
+static uint64_t *pmm_summary_full;
+static uint64_t *pmm_summary_free;
+static size_t pmm_summary_words;
+
+/* One bit per page, set while the page sits in a per-CPU magazine or the
+   depot. Such pages stay marked used in the bitmap, so this is what tells
+   a second free of a cached page from a first one. Updated atomically,
+   without pmm_lock. Lives after the summary layer. */
+static uint64_t *pmm_cached;
+
+static size_t pmm_usable_pages;  // pages the memmap reported usable
+static uint64_t pmm_init_cycles; // timestamp ticks spent in pmm_init_after_kernel
+
+/* ---- deferred initialization ----
+   At boot only the first PMM_EAGER_PAGES usable pages are handed to the
+   buddy allocator. The rest stay marked used and are released in batches
+   later: when the free pool drops under PMM_DEFER_LOW_WATER, when an
+   allocation would otherwise fail, or from the idle loop through
+   pmm_deferred_init_step(). Build with -DPMM_DEFERRED_INIT=0 to release
+   everything up front instead. */
+#ifndef PMM_DEFERRED_INIT
+#define PMM_DEFERRED_INIT 1
+#endif
+#define PMM_EAGER_PAGES ((size_t)(1ul << 30) / PAGE_SIZE)  // 1 GiB
+#define PMM_DEFER_BATCH ((size_t)(64ul << 20) / PAGE_SIZE) // 64 MiB
+#define PMM_DEFER_LOW_WATER ((size_t)(16ul << 20) / PAGE_SIZE)
+
+static struct limine_memmap_response *pmm_memmap;
+static uint64_t pmm_defer_entry;      // memmap entry the release cursor is in
+static size_t pmm_defer_page;         // next page to release within that entry
+static size_t pmm_deferred_pages;     // usable pages not released yet
+static uint64_t pmm_deferred_cycles;  // ticks spent releasing deferred pages
+
+/* Page ranges inside usable memory that must never reach the free lists:
+   the kernel image, the bitmap itself and page 0. */
+#define PMM_HOLES 3
+static struct
+{
+  size_t start;
+  size_t end;
+} pmm_holes[PMM_HOLES];
+
+/* ---- buddy allocator ----
+   Free blocks of 2^order pages live on per-order doubly linked lists. The
+   list node is stored in the first page of the free block itself (through
+   the HHDM), so the allocator needs no memory of its own. The bitmap stays
+   authoritative: a page is free exactly when it is inside a block on one of
+   these lists, which is what lets free() find a free buddy in O(1).
+
+   Every NUMA node has one set of lists per zone. A free block records its
+   zone, and buddies only merge within a zone, so no block ever straddles a
+   zone or node boundary. */
+#define PMM_FREE_MAGIC 0xf4eeb10c
+
+#define PMM_DMA_LIMIT ((size_t)(16ul << 20) / PAGE_SIZE)  // first page above ZONE_DMA
+#define PMM_DMA32_LIMIT ((size_t)(4ul << 30) / PAGE_SIZE) // first page above ZONE_DMA32
+#define PMM_ZONES (NUMA_MAX_NODES * PMM_ZONE_COUNT)
+
+struct pmm_free_block
+{
+  struct pmm_free_block *next;
+  struct pmm_free_block *prev;
+  uint32_t magic;
+  uint16_t order;
+  uint16_t zone; // index into pmm_zones
+};
+
+struct pmm_zone
+{
+  struct pmm_free_block *free_area[PMM_MAX_ORDER + 1];
+  size_t free_count[PMM_MAX_ORDER + 1]; // blocks on each list
+  size_t nr_free;                       // pages on all lists
+  size_t span_start;                    // lowest page ever released to the zone
+  size_t span_end;                      // one past the highest
+  size_t hint;                          // next-fit start for runs above PMM_MAX_ORDER
+};
+
+static struct pmm_zone pmm_zones[PMM_ZONES]; // node * PMM_ZONE_COUNT + zone
+static size_t pmm_nr_free;                   // pages on all lists of all zones
+
+/* Protects the bitmap, summary and buddy lists. */
+static spinlock_t pmm_lock = SPINLOCK_INIT;
+
+/* ---- per-CPU page magazines ----
+   Single pages are cached per CPU in two magazines (stacks of page
+   addresses), loaded and previous, in front of the buddy allocator. Only
+   when both are empty (or both full) does a CPU go to the shared depot of
+   full/empty magazines, and only when the depot cannot help does it refill
+   or drain a batch against the buddy allocator. The hit path touches only
+   the CPU's own cache lines and takes no lock. Pages sitting in a magazine
+   are marked used in the bitmap. */
+#define PMM_MAG_SIZE 32    // pages per magazine
+#define PMM_DEPOT_MAX 16   // full magazines the depot may hold
+#define PMM_MAG_COUNT (MAX_CPUS * 2 + PMM_DEPOT_MAX)
+
+struct pmm_magazine
+{
+  struct pmm_magazine *next; // depot list link
+  size_t count;
+  uintptr_t pages[PMM_MAG_SIZE];
+} __cacheline_aligned;
+
+struct pmm_pcpu
+{
+  struct pmm_magazine *loaded;
+  struct pmm_magazine *previous;
+  uint64_t alloc_hits;
+  uint64_t alloc_misses;
+  uint64_t free_hits;
+  uint64_t free_misses;
+  uint64_t refills;
+  uint64_t drains;
+} __cacheline_aligned;
+
+static struct pmm_magazine pmm_mag_pool[PMM_MAG_COUNT];
+static struct pmm_pcpu pmm_pcpu[MAX_CPUS];
+
+static struct
+{
+  spinlock_t lock;
+  struct pmm_magazine *full;
+  struct pmm_magazine *empty;
+  size_t full_count;
+} pmm_depot __cacheline_aligned = {SPINLOCK_INIT, NULL, NULL, 0};
+
+static bool pmm_ready;
+
+/* ---- huge page pool ----
+   2 MiB-aligned 2 MiB chunks (one order-9 buddy block each) set aside at
+   init for consumers that want to map their memory with large pages. Free
+   chunks are linked through their first page, like buddy blocks. The pool
+   keeps at most `reserved` free chunks; chunks beyond that, handed out by
+   the fallback path when the pool ran dry, go back to the buddy allocator. */
+#define PMM_HUGE_ORDER 9
+#define PMM_HUGE_POOL_CHUNKS 8 // 16 MiB reserved at boot
+
+static struct
+{
+  spinlock_t lock;
+  uintptr_t free;  // physical address of the first free chunk, 0 if none
+  size_t nr_free;  // chunks in the pool
+  size_t reserved; // chunks the pool holds on to
+} pmm_huge = {SPINLOCK_INIT, 0, 0, 0};
+
+/* bitmap helpers */
+#define WORD_BITS 64
+#define WORD_FULL (~(uint64_t)0)
+#define PMM_NO_RUN ((size_t)-1)
+
+#define BIT_TEST(i) (pmm_bitmap[(i) / WORD_BITS] & ((uint64_t)1 << ((i) % WORD_BITS)))
+
+/* Mark a page as cached in a magazine; false if it already was. */
+static inline bool pmm_cache_mark(uintptr_t phys)
+{
+  size_t page = phys / PAGE_SIZE;
+  uint64_t bit = (uint64_t)1 << (page % WORD_BITS);
+  return !(__atomic_fetch_or(&pmm_cached[page / WORD_BITS], bit, __ATOMIC_ACQ_REL) & bit);
+}
+
+static inline void pmm_cache_unmark(uintptr_t phys)
+{
+  size_t page = phys / PAGE_SIZE;
+  __atomic_fetch_and(&pmm_cached[page / WORD_BITS], ~((uint64_t)1 << (page % WORD_BITS)), __ATOMIC_ACQ_REL);
+}
+
 __attribute__((used, section(".limine_requests"))) static volatile struct limine_memmap_request memmap_req = {
     .id = LIMINE_MEMMAP_REQUEST,
     .revision = 0};
@@ -14,47 +195,458 @@ __attribute__((used, section(".limine_requests"))) static volatile struct limine
     .id = LIMINE_HHDM_REQUEST,
     .revision = 0};
 
-static inline unsigned long irq_save(void)
+uintptr_t hhdm_offset(void)
 {
-  unsigned long flags;
-  __asm__ __volatile__("pushfq; popq %0; cli" : "=r"(flags)::"memory");
-  return flags;
+  // Must check response is non-NULL before calling in real init path.
+  return (uintptr_t)hhdm_req.response->offset;
 }
 
-static inline void irq_restore(unsigned long flags)
+/* Recompute the summary bits of bitmap word w. */
+static inline void pmm_summary_update(size_t w)
 {
-  __asm__ __volatile__("pushq %0; popfq" ::"r"(flags) : "memory", "cc");
+  uint64_t bit = (uint64_t)1 << (w % WORD_BITS);
+  size_t s = w / WORD_BITS;
+  uint64_t word = pmm_bitmap[w];
+
+  if (word == WORD_FULL)
+    pmm_summary_full[s] |= bit;
+  else
+    pmm_summary_full[s] &= ~bit;
+
+  if (word == 0)
+    pmm_summary_free[s] |= bit;
+  else
+    pmm_summary_free[s] &= ~bit;
 }
 
-static inline uintptr_t hhdm_offset(void)
+/* First bitmap word at or after w that has at least one free page,
+   or pmm_bitmap_words if there is none. */
+static size_t pmm_next_nonfull_word(size_t w)
 {
-  // Must check response is non-NULL before calling in real init path.
-  return (uintptr_t)hhdm_req.response->offset;
+  size_t s = w / WORD_BITS;
+  if (s >= pmm_summary_words)
+    return pmm_bitmap_words;
+
+  uint64_t m = ~pmm_summary_full[s] & (WORD_FULL << (w % WORD_BITS));
+  while (!m)
+  {
+    if (++s >= pmm_summary_words)
+      return pmm_bitmap_words;
+    m = ~pmm_summary_full[s];
+  }
+  return s * WORD_BITS + __builtin_ctzll(m);
 }
 
-/* Convert a physical address to a kernel virtual (HHDM) pointer */
-static inline void *phys_to_virt(uintptr_t phys)
+/* Find `pages` consecutive free pages lying entirely inside [from, end).
+   Fully used words are skipped through the summary, fully free words are
+   counted 64 (or 64 * 64) pages at a time, and mixed words are walked one
+   run of equal bits at a time. Returns the first page or PMM_NO_RUN. */
+static size_t pmm_find_free_run(size_t from, size_t end, size_t pages)
 {
-  return (void *)(phys + hhdm_offset());
+  size_t run = 0;
+  size_t start = 0;
+  size_t i = from;
+
+  while (i < end)
+  {
+    size_t w = i / WORD_BITS;
+    unsigned int bit = i % WORD_BITS;
+    uint64_t word = pmm_bitmap[w];
+
+    if (bit == 0 && word == WORD_FULL)
+    {
+      run = 0;
+      i = pmm_next_nonfull_word(w + 1) * WORD_BITS;
+      continue;
+    }
+
+    size_t n;
+    if (bit == 0 && word == 0)
+    {
+      n = WORD_BITS;
+      if (w % WORD_BITS == 0 && pmm_summary_free[w / WORD_BITS] == WORD_FULL)
+        n = WORD_BITS * WORD_BITS;
+    }
+    else
+    {
+      uint64_t rest = word >> bit;
+      if (rest & 1)
+      {
+        /* skip the used bits; the zeros shifted in on top bound the count */
+        run = 0;
+        i += __builtin_ctzll(~rest);
+        continue;
+      }
+      n = rest ? (size_t)__builtin_ctzll(rest) : WORD_BITS - bit;
+    }
+
+    if (run == 0)
+      start = i;
+    run += n;
+    i += n;
+
+    if (run >= pages)
+      return (start + pages <= end) ? start : PMM_NO_RUN;
+  }
+
+  return PMM_NO_RUN;
 }
 
-/* Convert a kernel virtual (HHDM) pointer back to physical */
-static inline uintptr_t virt_to_phys(const void *virt)
+/* Like pmm_find_free_run, but the first page must be a multiple of align
+   (a power of two). */
+static size_t pmm_find_aligned_run(size_t from, size_t end, size_t pages, size_t align)
 {
-  return (uintptr_t)virt - hhdm_offset();
+  from = align_up(from, align);
+  while (from < end)
+  {
+    size_t start = pmm_find_free_run(from, end, pages);
+    if (start == PMM_NO_RUN || start % align == 0)
+      return start;
+    // No aligned run can start before the first unaligned one.
+    from = align_up(start, align);
+  }
+  return PMM_NO_RUN;
 }
 
-static inline uintptr_t align_up(uintptr_t a, uintptr_t align)
+/* Next-fit search for an aligned free run in [from, end): from the hint to
+   the end, then wrap around to the start. */
+static size_t pmm_search_run(size_t from, size_t end, size_t *hint, size_t pages, size_t align)
 {
-  return (a + align - 1) & ~(align - 1);
+  if (*hint < from || *hint >= end)
+    *hint = from;
+
+  size_t start = pmm_find_aligned_run(*hint, end, pages, align);
+  if (start == PMM_NO_RUN)
+  {
+    size_t wrap = *hint + pages - 1;
+    if (wrap > end)
+      wrap = end;
+    start = pmm_find_aligned_run(from, wrap, pages, align);
+    if (start == PMM_NO_RUN)
+      return PMM_NO_RUN;
+  }
+
+  *hint = start + pages;
+  return start;
 }
-static inline uintptr_t align_down(uintptr_t a, uintptr_t align)
+
+/* First used page at or after page, or pmm_total_pages. */
+static size_t pmm_free_run_end(size_t page)
 {
-  return a & ~(align - 1);
+  while (page < pmm_total_pages)
+  {
+    size_t w = page / WORD_BITS;
+    unsigned int bit = page % WORD_BITS;
+
+    if (bit == 0 && w % WORD_BITS == 0 && pmm_summary_free[w / WORD_BITS] == WORD_FULL)
+    {
+      page += WORD_BITS * WORD_BITS;
+      continue;
+    }
+
+    uint64_t rest = pmm_bitmap[w] >> bit;
+    if (rest)
+      return page + __builtin_ctzll(rest);
+    page += WORD_BITS - bit;
+  }
+  return pmm_total_pages;
+}
+
+/* Set or clear `count` bits of map starting at bit `first`: partial head and
+   tail words are masked, whole words in between are stored directly. */
+static void pmm_bits_fill(uint64_t *map, size_t first, size_t count, bool set)
+{
+  if (count == 0)
+    return;
+
+  size_t w = first / WORD_BITS;
+  size_t last = (first + count - 1) / WORD_BITS;
+  uint64_t head = WORD_FULL << (first % WORD_BITS);
+  uint64_t tail = WORD_FULL >> (WORD_BITS - 1 - (first + count - 1) % WORD_BITS);
+
+  if (w == last)
+    head &= tail;
+  map[w] = set ? (map[w] | head) : (map[w] & ~head);
+  if (w == last)
+    return;
+
+  uint64_t fill = set ? WORD_FULL : 0;
+  for (size_t i = w + 1; i < last; i++)
+    map[i] = fill;
+  map[last] = set ? (map[last] | tail) : (map[last] & ~tail);
+}
+
+/* Mark [first_page, first_page + pages) used or free in the bitmap and keep
+   the summary in step. Only the (at most two) partial words need their
+   summary bits recomputed; every whole word in between is known to be full
+   or free, so its summary bits are filled the same way. */
+static void pmm_mark_range(size_t first_page, size_t pages, bool used)
+{
+  if (first_page >= pmm_total_pages || pages == 0)
+    return;
+  if (pages > pmm_total_pages - first_page)
+    pages = pmm_total_pages - first_page;
+
+  pmm_bits_fill(pmm_bitmap, first_page, pages, used);
+
+  size_t w = first_page / WORD_BITS;
+  size_t last = (first_page + pages - 1) / WORD_BITS;
+  pmm_summary_update(w);
+  if (last != w)
+  {
+    pmm_summary_update(last);
+    pmm_bits_fill(pmm_summary_full, w + 1, last - w - 1, used);
+    pmm_bits_fill(pmm_summary_free, w + 1, last - w - 1, !used);
+  }
+}
+
+static void pmm_mark_range_used(size_t first_page, size_t pages)
+{
+  pmm_mark_range(first_page, pages, true);
+}
+
+static void pmm_mark_range_free(size_t first_page, size_t pages)
+{
+  pmm_mark_range(first_page, pages, false);
+}
+
+/* First free page at or after page, or pmm_total_pages. */
+static size_t pmm_used_run_end(size_t page)
+{
+  while (page < pmm_total_pages)
+  {
+    size_t w = page / WORD_BITS;
+    unsigned int bit = page % WORD_BITS;
+
+    if (bit == 0 && pmm_bitmap[w] == WORD_FULL)
+    {
+      page = pmm_next_nonfull_word(w + 1) * WORD_BITS;
+      continue;
+    }
+
+    // Bits shifted in from the top read as used; the real word ends first.
+    uint64_t rest = ~(pmm_bitmap[w] >> bit) & (WORD_FULL >> bit);
+    if (rest)
+    {
+      page += __builtin_ctzll(rest);
+      return page < pmm_total_pages ? page : pmm_total_pages;
+    }
+    page += WORD_BITS - bit;
+  }
+  return pmm_total_pages;
+}
+
+/* Smallest order whose block holds at least `pages` pages. */
+static inline unsigned int pmm_order_for(size_t pages)
+{
+  unsigned int order = 0;
+  while (((size_t)1 << order) < pages)
+    order++;
+  return order;
+}
+
+static inline struct pmm_free_block *pmm_block_at(size_t page)
+{
+  return (struct pmm_free_block *)phys_to_virt(page * PAGE_SIZE);
+}
+
+static inline size_t pmm_block_page(const struct pmm_free_block *b)
+{
+  return virt_to_phys(b) / PAGE_SIZE;
+}
+
+static inline unsigned int pmm_zone_type(size_t page)
+{
+  if (page < PMM_DMA_LIMIT)
+    return PMM_ZONE_DMA;
+  if (page < PMM_DMA32_LIMIT)
+    return PMM_ZONE_DMA32;
+  return PMM_ZONE_NORMAL;
+}
+
+/* Index into pmm_zones of the zone a page belongs to. */
+static inline unsigned int pmm_zone_of(size_t page)
+{
+  unsigned int node = numa_node_count() > 1 ? numa_page_node(page) : 0;
+  return node * PMM_ZONE_COUNT + pmm_zone_type(page);
+}
+
+static void pmm_list_push(size_t page, unsigned int order, unsigned int zone)
+{
+  struct pmm_zone *z = &pmm_zones[zone];
+  struct pmm_free_block *b = pmm_block_at(page);
+  b->magic = PMM_FREE_MAGIC;
+  b->order = order;
+  b->zone = zone;
+  b->prev = NULL;
+  b->next = z->free_area[order];
+  if (b->next)
+    b->next->prev = b;
+  z->free_area[order] = b;
+  z->free_count[order]++;
+  z->nr_free += (size_t)1 << order;
+  pmm_nr_free += (size_t)1 << order;
+}
+
+static void pmm_list_remove(struct pmm_free_block *b)
+{
+  struct pmm_zone *z = &pmm_zones[b->zone];
+  unsigned int order = b->order;
+  if (b->prev)
+    b->prev->next = b->next;
+  else
+    z->free_area[order] = b->next;
+  if (b->next)
+    b->next->prev = b->prev;
+  b->magic = 0;
+  z->free_count[order]--;
+  z->nr_free -= (size_t)1 << order;
+  pmm_nr_free -= (size_t)1 << order;
+}
+
+/* Is there a free block of exactly `order` in `zone` starting at page? Only
+   valid for pages aligned to the order: such a page is either the head of a
+   free block or not free at all, so the in-page header can be trusted. */
+static inline bool pmm_block_is_free(size_t page, unsigned int order, unsigned int zone)
+{
+  if (page + ((size_t)1 << order) > pmm_total_pages || BIT_TEST(page))
+    return false;
+  struct pmm_free_block *b = pmm_block_at(page);
+  return b->magic == PMM_FREE_MAGIC && b->order == order && b->zone == zone;
+}
+
+/* Put an already bitmap-free block on the free lists of `zone`, merging it
+   with its buddy for as long as the buddy is free too. */
+static void pmm_buddy_insert(size_t page, unsigned int order, unsigned int zone)
+{
+  while (order < PMM_MAX_ORDER)
+  {
+    size_t buddy = page ^ ((size_t)1 << order);
+    if (!pmm_block_is_free(buddy, order, zone))
+      break;
+    pmm_list_remove(pmm_block_at(buddy));
+    page &= ~((size_t)1 << order);
+    order++;
+  }
+  pmm_list_push(page, order, zone);
+}
+
+/* Insert the bitmap-free range [start, end), which lies within one zone, as
+   maximal aligned blocks. */
+static void pmm_buddy_insert_range(size_t start, size_t end, unsigned int zone)
+{
+  while (start < end)
+  {
+    unsigned int order = start ? __builtin_ctzll(start) : PMM_MAX_ORDER;
+    if (order > PMM_MAX_ORDER)
+      order = PMM_MAX_ORDER;
+    while (((size_t)1 << order) > end - start)
+      order--;
+    pmm_buddy_insert(start, order, zone);
+    start += (size_t)1 << order;
+  }
+}
+
+/* Mark [start, end) free and insert it, split at zone and node boundaries. */
+static void pmm_release_zoned(size_t start, size_t end)
+{
+  while (start < end)
+  {
+    size_t piece = end;
+    if (start < PMM_DMA_LIMIT && piece > PMM_DMA_LIMIT)
+      piece = PMM_DMA_LIMIT;
+    if (start < PMM_DMA32_LIMIT && piece > PMM_DMA32_LIMIT)
+      piece = PMM_DMA32_LIMIT;
+    if (numa_node_count() > 1 && piece > numa_range_end(start))
+      piece = numa_range_end(start);
+
+    unsigned int zone = pmm_zone_of(start);
+    struct pmm_zone *z = &pmm_zones[zone];
+    if (z->span_end == 0 || start < z->span_start)
+      z->span_start = start;
+    if (piece > z->span_end)
+      z->span_end = piece;
+
+    pmm_mark_range_free(start, piece - start);
+    pmm_buddy_insert_range(start, piece, zone);
+    start = piece;
+  }
+}
+
+/* Release [start, end) to the bitmap and buddy lists, skipping the holes
+   from `hole` onwards. */
+static void pmm_release_range(size_t start, size_t end, unsigned int hole)
+{
+  for (; hole < PMM_HOLES && start < end; hole++)
+  {
+    if (pmm_holes[hole].end <= start || pmm_holes[hole].start >= end)
+      continue;
+    if (pmm_holes[hole].start > start)
+      pmm_release_range(start, pmm_holes[hole].start, hole + 1);
+    start = pmm_holes[hole].end;
+  }
+
+  if (start < end)
+    pmm_release_zoned(start, end);
+}
+
+/* Walk the memmap from the release cursor and release up to `budget`
+   usable pages. Returns how many pages were consumed. */
+static size_t pmm_release_usable(size_t budget)
+{
+  size_t done = 0;
+
+  while (done < budget && pmm_defer_entry < pmm_memmap->entry_count)
+  {
+    struct limine_memmap_entry *e = pmm_memmap->entries[pmm_defer_entry];
+    size_t start_page = align_up(e->base, PAGE_SIZE) / PAGE_SIZE;
+    size_t end_page = (e->base + e->length) / PAGE_SIZE;
+    if (end_page > pmm_total_pages)
+      end_page = pmm_total_pages;
+    if (pmm_defer_page < start_page)
+      pmm_defer_page = start_page;
+
+    if (e->type != LIMINE_MEMMAP_USABLE || pmm_defer_page >= end_page)
+    {
+      pmm_defer_entry++;
+      pmm_defer_page = 0;
+      continue;
+    }
+
+    size_t chunk = end_page - pmm_defer_page;
+    if (chunk > budget - done)
+      chunk = budget - done;
+    pmm_release_range(pmm_defer_page, pmm_defer_page + chunk, 0);
+    pmm_defer_page += chunk;
+    done += chunk;
+  }
+
+  pmm_deferred_pages -= done;
+  return done;
+}
+
+/* Release another batch of deferred memory. Caller holds pmm_lock. */
+static size_t pmm_deferred_grow_locked(size_t pages)
+{
+  if (pmm_deferred_pages == 0)
+    return 0;
+
+  uint64_t start = cpu_timestamp();
+  size_t done = pmm_release_usable(pages);
+  pmm_deferred_cycles += cpu_timestamp() - start;
+  return done;
+}
+
+/* Top the free pool up from deferred memory once it runs low. */
+static inline void pmm_deferred_refill_locked(void)
+{
+  if (pmm_deferred_pages && pmm_nr_free < PMM_DEFER_LOW_WATER)
+    pmm_deferred_grow_locked(PMM_DEFER_BATCH);
 }
 
 void pmm_init_after_kernel(void)
 {
+  uint64_t init_start = cpu_timestamp();
   struct limine_memmap_response *memmap = memmap_req.response;
   if (!memmap)
   {
@@ -75,7 +667,9 @@ void pmm_init_after_kernel(void)
       max_addr = top;
   }
   pmm_total_pages = max_addr / PAGE_SIZE;
-  pmm_bitmap_bytes = (pmm_total_pages + 7) / 8;
+  pmm_bitmap_words = (pmm_total_pages + WORD_BITS - 1) / WORD_BITS;
+  pmm_summary_words = (pmm_bitmap_words + WORD_BITS - 1) / WORD_BITS;
+  pmm_bitmap_bytes = (2 * pmm_bitmap_words + 2 * pmm_summary_words) * sizeof(uint64_t);
   pmm_bitmap_pages = (pmm_bitmap_bytes + PAGE_SIZE - 1) / PAGE_SIZE;
 
   /* 2) Find a physical address just after the kernel image for the bitmap.
@@ -146,33 +740,33 @@ void pmm_init_after_kernel(void)
 
   pmm_bitmap_phys = bitmap_phys_candidate;
   /* Map it to kernel virtual via HHDM so we can write it */
-  pmm_bitmap = (uint8_t *)phys_to_virt(pmm_bitmap_phys);
+  pmm_bitmap = (uint64_t *)phys_to_virt(pmm_bitmap_phys);
+  pmm_summary_full = pmm_bitmap + pmm_bitmap_words;
+  pmm_summary_free = pmm_summary_full + pmm_summary_words;
+  pmm_cached = pmm_summary_free + pmm_summary_words;
 
-  /* 4) Initialize bitmap memory to all 1s (used) then mark usable regions free,
-        but also mark the bitmap pages themselves as used so we won't hand them out. */
+  /* 4) Initialize bitmap memory to all 1s (used). Usable memory is marked free
+        as it is released to the buddy allocator below. With every page used,
+        every summary word reads "full" and none "free" (including the padding
+        past the last word, which must stay that way). */
   memset(pmm_bitmap, 0xFF, pmm_bitmap_pages * PAGE_SIZE); // map may be larger than bitmap_bytes
-  // initialize entire bitmap to 1s first
-  // but make sure we only consider pmm_bitmap_bytes logically (some bytes in the page may be unused)
-  // Next, mark usable ranges as free:
+  memset(pmm_summary_free, 0, pmm_summary_words * sizeof(uint64_t));
+  memset(pmm_cached, 0, pmm_bitmap_words * sizeof(uint64_t));
+
+  pmm_usable_pages = 0;
   for (uint64_t i = 0; i < memmap->entry_count; i++)
   {
     struct limine_memmap_entry *e = memmap->entries[i];
     if (e->type == LIMINE_MEMMAP_USABLE)
     {
-      uintptr_t start_page = e->base / PAGE_SIZE;
+      uintptr_t start_page = align_up(e->base, PAGE_SIZE) / PAGE_SIZE;
       uintptr_t end_page = (e->base + e->length) / PAGE_SIZE;
-      for (uintptr_t p = start_page; p < end_page; p++)
-      {
-        size_t byte_index = p / 8;
-        if (byte_index < pmm_bitmap_bytes)
-        {
-          pmm_bitmap[byte_index] &= ~(1u << (p & 7));
-        }
-      }
+      if (end_page > start_page)
+        pmm_usable_pages += end_page - start_page;
     }
   }
 
-  /* 5) Mark kernel pages used (so they aren't allocated later) */
+  /* 5) Keep kernel pages used (so they aren't allocated later) */
   uintptr_t kernel_start_phys = /* if you have symbol for start, use it */ 0;
   // If you don't have start symbol, you can at least mark from 0..kernel_end if kernel is at low memory.
   // Ideally have _kernel_start provided by linker. I'll assume identity: kernel_start_phys = 0x100000;
@@ -181,68 +775,705 @@ void pmm_init_after_kernel(void)
   if (hhdm_req.response)
     kernel_start_phys = virt_to_phys((void *)kernel_start_phys);
 
-  uintptr_t kstart_page = kernel_start_phys / PAGE_SIZE;
-  uintptr_t kend_page = align_up(kernel_end_phys, PAGE_SIZE) / PAGE_SIZE;
-  for (uintptr_t p = kstart_page; p < kend_page; p++)
+  pmm_holes[0].start = kernel_start_phys / PAGE_SIZE;
+  pmm_holes[0].end = align_up(kernel_end_phys, PAGE_SIZE) / PAGE_SIZE;
+
+  /* 6) Keep bitmap pages themselves used in the bitmap */
+  pmm_holes[1].start = pmm_bitmap_phys / PAGE_SIZE;
+  pmm_holes[1].end = pmm_holes[1].start + pmm_bitmap_pages;
+
+  /* 7) Physical page 0 doubles as the allocation failure value, never hand it out */
+  pmm_holes[2].start = 0;
+  pmm_holes[2].end = 1;
+
+  /* 8) Release usable memory to the buddy allocator: the first GiB now and
+        the rest later, or everything now without deferral. Blocks go to the
+        zone and node they belong to, as described by the ACPI SRAT. */
+  numa_init();
+  memset(pmm_zones, 0, sizeof(pmm_zones));
+  pmm_nr_free = 0;
+
+  pmm_memmap = memmap;
+  pmm_defer_entry = 0;
+  pmm_defer_page = 0;
+  pmm_deferred_pages = pmm_usable_pages;
+  pmm_release_usable(PMM_DEFERRED_INIT ? PMM_EAGER_PAGES : pmm_usable_pages);
+
+  /* 9) Give every CPU its two empty magazines, the rest go to the depot */
+  for (size_t c = 0; c < MAX_CPUS; c++)
   {
-    if ((p / 8) < pmm_bitmap_bytes)
-      BIT_SET(p);
+    pmm_pcpu[c].loaded = &pmm_mag_pool[2 * c];
+    pmm_pcpu[c].previous = &pmm_mag_pool[2 * c + 1];
   }
-
-  /* 6) Mark bitmap pages themselves used in the bitmap */
-  uintptr_t bstart = pmm_bitmap_phys / PAGE_SIZE;
-  for (uintptr_t p = bstart; p < bstart + pmm_bitmap_pages; p++)
+  for (size_t m = 2 * MAX_CPUS; m < PMM_MAG_COUNT; m++)
   {
-    if ((p / 8) < pmm_bitmap_bytes)
-      BIT_SET(p);
+    pmm_mag_pool[m].next = pmm_depot.empty;
+    pmm_depot.empty = &pmm_mag_pool[m];
   }
+  pmm_ready = true;
+
+  /* 10) Set aside the huge page pool */
+  pmm_huge_reserve(PMM_HUGE_POOL_CHUNKS);
+
+  pmm_init_cycles = cpu_timestamp() - init_start;
 }
 
-uintptr_t pmm_alloc_pages(size_t pages)
+static uintptr_t pmm_buddy_alloc(unsigned int order, unsigned int zone)
 {
-  if (pages == 0)
+  struct pmm_zone *z = &pmm_zones[zone];
+  if (order > PMM_MAX_ORDER || z->nr_free < ((size_t)1 << order))
     return 0;
 
-  size_t run = 0;
-  size_t start_page = 0;
+  unsigned int o = order;
+  while (o <= PMM_MAX_ORDER && !z->free_area[o])
+    o++;
+  if (o > PMM_MAX_ORDER)
+    return 0;
 
-  for (size_t i = 0; i < pmm_total_pages; i++)
+  struct pmm_free_block *b = z->free_area[o];
+  size_t page = pmm_block_page(b);
+  pmm_list_remove(b);
+
+  // Split down, returning the upper halves to their lists.
+  while (o > order)
   {
-    if (!BIT_TEST(i))
+    o--;
+    pmm_list_push(page + ((size_t)1 << o), o, zone);
+  }
+
+  pmm_mark_range_used(page, (size_t)1 << order);
+  return page * PAGE_SIZE;
+}
+
+static void pmm_buddy_free(uintptr_t phys_addr, unsigned int order)
+{
+  size_t page = phys_addr / PAGE_SIZE;
+  size_t pages = (size_t)1 << order;
+
+  if (order > PMM_MAX_ORDER || (page & (pages - 1)) || page + pages > pmm_total_pages)
+    return;
+  if (!BIT_TEST(page))
+    return; // double free
+
+  pmm_mark_range_free(page, pages);
+  pmm_buddy_insert(page, order, pmm_zone_of(page));
+}
+
+/* Highest zone the flags allow. */
+static inline unsigned int pmm_zone_limit(unsigned int flags)
+{
+  if (flags & PMM_DMA)
+    return PMM_ZONE_DMA;
+  if (flags & PMM_DMA32)
+    return PMM_ZONE_DMA32;
+  return PMM_ZONE_NORMAL;
+}
+
+/* Walk the zones the flags allow in preference order: the local node (or
+   node 0) first, and within a node from the highest allowed zone down, so
+   DMA-capable memory is used last. Returns the next zone index after
+   `*step` or -1 once exhausted; start with *step = 0. */
+static int pmm_zone_next(unsigned int flags, unsigned int *step)
+{
+  unsigned int top = pmm_zone_limit(flags);
+  unsigned int nodes = (flags & PMM_THISNODE) ? 1 : numa_node_count();
+  unsigned int first = (flags & (PMM_LOCAL | PMM_THISNODE)) ? numa_local_node() : 0;
+
+  if (*step >= nodes * (top + 1))
+    return -1;
+
+  unsigned int node = (first + *step / (top + 1)) % numa_node_count();
+  unsigned int zone = top - *step % (top + 1);
+  (*step)++;
+  return node * PMM_ZONE_COUNT + zone;
+}
+
+static uintptr_t pmm_buddy_alloc_flags(unsigned int order, unsigned int flags)
+{
+  unsigned int step = 0;
+  int zone;
+  while ((zone = pmm_zone_next(flags, &step)) >= 0)
+  {
+    uintptr_t phys = pmm_buddy_alloc(order, zone);
+    if (phys)
+      return phys;
+  }
+  return 0;
+}
+
+/* Allocate a buddy block, releasing deferred memory when the pool runs low
+   or the allocation would fail. Caller holds pmm_lock. */
+static uintptr_t pmm_buddy_alloc_grow(unsigned int order, unsigned int flags)
+{
+  pmm_deferred_refill_locked();
+  uintptr_t phys = pmm_buddy_alloc_flags(order, flags);
+  while (!phys && pmm_deferred_grow_locked(PMM_DEFER_BATCH))
+    phys = pmm_buddy_alloc_flags(order, flags);
+  return phys;
+}
+
+/* The free block containing a bitmap-free page, or NULL. Candidate heads
+   are tried from the largest order down; a real header at the candidate
+   for order o covers the page, so the first match is the containing block.
+   Interior pages of a free block may hold stale bytes, so a match must also
+   be linked into its list. */
+static struct pmm_free_block *pmm_block_containing(size_t page)
+{
+  for (int o = PMM_MAX_ORDER; o >= 0; o--)
+  {
+    size_t head = page & ~(((size_t)1 << o) - 1);
+    if (BIT_TEST(head))
+      continue;
+    struct pmm_free_block *b = pmm_block_at(head);
+    if (b->magic != PMM_FREE_MAGIC || b->order != (unsigned int)o || b->zone >= PMM_ZONES)
+      continue;
+
+    struct pmm_free_block *prev = b->prev;
+    if (!prev)
     {
-      if (run == 0)
-        start_page = i;
-      run++;
+      if (pmm_zones[b->zone].free_area[o] == b)
+        return b;
+      continue;
+    }
+    uintptr_t prev_phys = (uintptr_t)prev - hhdm_offset();
+    if ((uintptr_t)prev >= hhdm_offset() && !(prev_phys & (PAGE_SIZE - 1)) &&
+        prev_phys / PAGE_SIZE < pmm_total_pages && prev->next == b)
+      return b;
+  }
+  return NULL;
+}
+
+/* Exact runs: find `pages` free pages of one zone starting on an
+   `align`-page boundary anywhere in the bitmap, unlink the free blocks that
+   cover them and give back the parts of the first and last block outside
+   the run. Serves runs above the largest buddy block, and smaller ones when
+   no single block is large enough but the memory is there. */
+static uintptr_t pmm_alloc_run_zone(size_t pages, size_t align, unsigned int zone)
+{
+  struct pmm_zone *z = &pmm_zones[zone];
+  size_t from = z->span_start;
+
+  if (z->nr_free < pages)
+    return 0;
+
+  for (;;)
+  {
+    size_t start = pmm_search_run(from, z->span_end, &z->hint, pages, align);
+    if (start == PMM_NO_RUN)
+      return 0;
+    size_t end = start + pages;
+
+    // The run is free, but with several nodes it may reach into another
+    // zone's blocks: then search on behind the foreign block.
+    size_t p = start;
+    struct pmm_free_block *b = NULL;
+    while (p < end)
+    {
+      b = pmm_block_containing(p);
+      if (!b || b->zone != zone)
+        break;
+      p = pmm_block_page(b) + ((size_t)1 << b->order);
+    }
+    if (p < end)
+    {
+      size_t next = b ? pmm_block_page(b) + ((size_t)1 << b->order) : p + 1;
+      if (next >= z->span_end)
+        return 0;
+      from = z->hint = next;
+      continue;
+    }
+
+    size_t head = start, tail = end;
+    for (p = start; p < end; p = tail)
+    {
+      b = pmm_block_containing(p);
+      if (p == start)
+        head = pmm_block_page(b);
+      tail = pmm_block_page(b) + ((size_t)1 << b->order);
+      pmm_list_remove(b);
+    }
+
+    pmm_mark_range_used(start, pages);
+    pmm_buddy_insert_range(head, start, zone);
+    pmm_buddy_insert_range(end, tail, zone);
+    return start * PAGE_SIZE;
+  }
+}
 
-      if (run == pages)
+static uintptr_t pmm_alloc_run(size_t pages, size_t align, unsigned int flags)
+{
+  unsigned int step = 0;
+  int zone;
+  while ((zone = pmm_zone_next(flags, &step)) >= 0)
+  {
+    uintptr_t phys = pmm_alloc_run_zone(pages, align, zone);
+    if (phys)
+      return phys;
+  }
+  return 0;
+}
+
+/* Allocate `pages` pages starting on an `align`-page boundary (a power of
+   two). Buddy blocks are naturally aligned, so the block order only has to
+   cover the larger of the two. */
+static uintptr_t pmm_alloc_pages_locked(size_t pages, size_t align, unsigned int flags)
+{
+  if (pages == 0 || pages > pmm_total_pages)
+    return 0;
+
+  unsigned int order = pmm_order_for(pages > align ? pages : align);
+  if (order <= PMM_MAX_ORDER)
+  {
+    uintptr_t phys = pmm_buddy_alloc_grow(order, flags);
+    if (phys)
+    {
+      // Give back the part of the block beyond the request.
+      size_t page = phys / PAGE_SIZE;
+      size_t block = (size_t)1 << order;
+      if (block > pages)
       {
-        // Mark pages as used
-        for (size_t j = start_page; j < start_page + pages; j++)
-        {
-          BIT_SET(j);
-        }
-        return start_page * PAGE_SIZE; // return physical address
+        pmm_mark_range_free(page + pages, block - pages);
+        pmm_buddy_insert_range(page + pages, page + block, pmm_zone_of(page));
       }
+      return phys;
     }
-    else
+    // An unaligned page is the block itself: the run search cannot do
+    // better. An aligned one may still sit inside a smaller free block.
+    if (pages == 1 && align <= 1)
+      return 0;
+  }
+
+  // Too large for a buddy block, or no free block is large enough: look
+  // for an exact run instead.
+  pmm_deferred_refill_locked();
+  uintptr_t phys = pmm_alloc_run(pages, align, flags);
+  while (!phys && pmm_deferred_grow_locked(PMM_DEFER_BATCH))
+    phys = pmm_alloc_run(pages, align, flags);
+  return phys;
+}
+
+static void pmm_free_pages_locked(uintptr_t phys_addr, size_t pages)
+{
+  if (pages == 0)
+    return;
+
+  size_t start_page = phys_addr / PAGE_SIZE;
+  if (start_page >= pmm_total_pages)
+    return;
+  if (pages > pmm_total_pages - start_page)
+    pages = pmm_total_pages - start_page;
+
+  // Only give back pages that are actually allocated.
+  size_t end_page = start_page + pages;
+  size_t p = start_page;
+  while (p < end_page)
+  {
+    p = pmm_free_run_end(p);
+    if (p >= end_page)
+      break;
+    size_t q = pmm_used_run_end(p);
+    if (q > end_page)
+      q = end_page;
+    pmm_release_zoned(p, q);
+    p = q;
+  }
+}
+
+/* Return every page of a magazine to the buddy allocator. Caller holds pmm_lock. */
+static void pmm_magazine_drain_locked(struct pmm_magazine *mag)
+{
+  while (mag->count)
+  {
+    uintptr_t phys = mag->pages[--mag->count];
+    pmm_cache_unmark(phys);
+    pmm_buddy_free(phys, 0);
+  }
+}
+
+/* Give the depot's full magazines back to the buddy allocator so their
+   pages can coalesce again. Used when a multi-page allocation fails. */
+static void pmm_depot_flush(void)
+{
+  unsigned long flags = spin_lock_irqsave(&pmm_depot.lock);
+  struct pmm_magazine *full = pmm_depot.full;
+  pmm_depot.full = NULL;
+  pmm_depot.full_count = 0;
+  spin_unlock(&pmm_depot.lock);
+
+  spin_lock(&pmm_lock);
+  for (struct pmm_magazine *m = full; m; m = m->next)
+    pmm_magazine_drain_locked(m);
+  spin_unlock(&pmm_lock);
+
+  spin_lock(&pmm_depot.lock);
+  while (full)
+  {
+    struct pmm_magazine *next = full->next;
+    full->next = pmm_depot.empty;
+    pmm_depot.empty = full;
+    full = next;
+  }
+  spin_unlock_irqrestore(&pmm_depot.lock, flags);
+}
+
+static uintptr_t pmm_magazine_alloc(void)
+{
+  unsigned long flags = irq_save();
+  struct pmm_pcpu *pc = &pmm_pcpu[cpu_id()];
+  struct pmm_magazine *mag = pc->loaded;
+
+  if (mag->count == 0 && pc->previous->count != 0)
+  {
+    pc->loaded = pc->previous;
+    pc->previous = mag;
+    mag = pc->loaded;
+  }
+
+  if (mag->count != 0)
+  {
+    uintptr_t phys = mag->pages[--mag->count];
+    pmm_cache_unmark(phys);
+    pc->alloc_hits++;
+    irq_restore(flags);
+    return phys;
+  }
+
+  // Both magazines are empty: swap the previous one for a full one from the depot.
+  pc->alloc_misses++;
+  spin_lock(&pmm_depot.lock);
+  struct pmm_magazine *full = pmm_depot.full;
+  if (full)
+  {
+    pmm_depot.full = full->next;
+    pmm_depot.full_count--;
+    pc->previous->next = pmm_depot.empty;
+    pmm_depot.empty = pc->previous;
+    pc->previous = mag;
+    pc->loaded = mag = full;
+  }
+  spin_unlock(&pmm_depot.lock);
+
+  // No full magazine to be had: refill half a magazine from the buddy allocator.
+  if (!full)
+  {
+    spin_lock(&pmm_lock);
+    while (mag->count < PMM_MAG_SIZE / 2)
     {
-      run = 0; // reset run
+      uintptr_t phys = pmm_buddy_alloc_grow(0, PMM_DEFAULT);
+      if (!phys)
+        break;
+      pmm_cache_mark(phys);
+      mag->pages[mag->count++] = phys;
     }
+    spin_unlock(&pmm_lock);
+    pc->refills++;
+  }
+
+  uintptr_t phys = mag->count ? mag->pages[--mag->count] : 0;
+  if (phys)
+    pmm_cache_unmark(phys);
+  irq_restore(flags);
+  return phys;
+}
+
+static void pmm_magazine_free(uintptr_t phys)
+{
+  unsigned long flags = irq_save();
+  struct pmm_pcpu *pc = &pmm_pcpu[cpu_id()];
+  struct pmm_magazine *mag = pc->loaded;
+
+  if (mag->count == PMM_MAG_SIZE && pc->previous->count != PMM_MAG_SIZE)
+  {
+    pc->loaded = pc->previous;
+    pc->previous = mag;
+    mag = pc->loaded;
+  }
+
+  if (mag->count != PMM_MAG_SIZE)
+  {
+    mag->pages[mag->count++] = phys;
+    pc->free_hits++;
+    irq_restore(flags);
+    return;
+  }
+
+  // Both magazines are full: park the previous one in the depot for an empty one.
+  pc->free_misses++;
+  spin_lock(&pmm_depot.lock);
+  struct pmm_magazine *empty = NULL;
+  if (pmm_depot.empty && pmm_depot.full_count < PMM_DEPOT_MAX)
+  {
+    empty = pmm_depot.empty;
+    pmm_depot.empty = empty->next;
+    pc->previous->next = pmm_depot.full;
+    pmm_depot.full = pc->previous;
+    pmm_depot.full_count++;
+    pc->previous = mag;
+    pc->loaded = mag = empty;
+  }
+  spin_unlock(&pmm_depot.lock);
+
+  // Depot is saturated: drain the previous magazine back into the buddy allocator.
+  if (!empty)
+  {
+    struct pmm_magazine *prev = pc->previous;
+    spin_lock(&pmm_lock);
+    pmm_magazine_drain_locked(prev);
+    spin_unlock(&pmm_lock);
+    pc->previous = mag;
+    pc->loaded = mag = prev;
+    pc->drains++;
+  }
+
+  mag->pages[mag->count++] = phys;
+  irq_restore(flags);
+}
+
+void pmm_magazine_stats(struct pmm_magazine_stats *out)
+{
+  memset(out, 0, sizeof(*out));
+  for (size_t c = 0; c < MAX_CPUS; c++)
+  {
+    struct pmm_pcpu *pc = &pmm_pcpu[c];
+    out->alloc_hits += pc->alloc_hits;
+    out->alloc_misses += pc->alloc_misses;
+    out->free_hits += pc->free_hits;
+    out->free_misses += pc->free_misses;
+    out->refills += pc->refills;
+    out->drains += pc->drains;
+  }
+  out->depot_full = pmm_depot.full_count;
+}
+
+/* Take free chunks for the huge page pool from the buddy allocator. */
+size_t pmm_huge_reserve(size_t chunks)
+{
+  size_t added = 0;
+  while (added < chunks)
+  {
+    uintptr_t phys = pmm_alloc_order(PMM_HUGE_ORDER);
+    if (!phys)
+      break;
+
+    unsigned long flags = spin_lock_irqsave(&pmm_huge.lock);
+    *(uintptr_t *)phys_to_virt(phys) = pmm_huge.free;
+    pmm_huge.free = phys;
+    pmm_huge.nr_free++;
+    pmm_huge.reserved++;
+    spin_unlock_irqrestore(&pmm_huge.lock, flags);
+    added++;
+  }
+  return added;
+}
+
+uintptr_t pmm_huge_alloc(void)
+{
+  unsigned long flags = spin_lock_irqsave(&pmm_huge.lock);
+  uintptr_t phys = pmm_huge.free;
+  if (phys)
+  {
+    pmm_huge.free = *(uintptr_t *)phys_to_virt(phys);
+    pmm_huge.nr_free--;
+  }
+  spin_unlock_irqrestore(&pmm_huge.lock, flags);
+
+  // Pool ran dry: an order-9 buddy block is just as aligned.
+  if (!phys)
+    phys = pmm_alloc_order(PMM_HUGE_ORDER);
+  return phys;
+}
+
+void pmm_huge_free(uintptr_t phys_addr)
+{
+  unsigned long flags = spin_lock_irqsave(&pmm_huge.lock);
+  if (pmm_huge.nr_free < pmm_huge.reserved)
+  {
+    *(uintptr_t *)phys_to_virt(phys_addr) = pmm_huge.free;
+    pmm_huge.free = phys_addr;
+    pmm_huge.nr_free++;
+    phys_addr = 0;
+  }
+  spin_unlock_irqrestore(&pmm_huge.lock, flags);
+
+  if (phys_addr)
+    pmm_free_order(phys_addr, PMM_HUGE_ORDER);
+}
+
+uintptr_t pmm_alloc_order_flags(unsigned int order, unsigned int flags)
+{
+  if (order == 0 && flags == PMM_DEFAULT && pmm_ready)
+    return pmm_magazine_alloc();
+
+  unsigned long irqflags = spin_lock_irqsave(&pmm_lock);
+  uintptr_t phys = pmm_buddy_alloc_grow(order, flags);
+  spin_unlock_irqrestore(&pmm_lock, irqflags);
+
+  if (!phys && order > 0 && pmm_depot.full_count)
+  {
+    pmm_depot_flush();
+    irqflags = spin_lock_irqsave(&pmm_lock);
+    phys = pmm_buddy_alloc_grow(order, flags);
+    spin_unlock_irqrestore(&pmm_lock, irqflags);
+  }
+  return phys;
+}
+
+uintptr_t pmm_alloc_order(unsigned int order)
+{
+  return pmm_alloc_order_flags(order, PMM_DEFAULT);
+}
+
+void pmm_free_order(uintptr_t phys_addr, unsigned int order)
+{
+  // Low DMA memory is scarce: let it go straight back to its zone.
+  if (order == 0 && pmm_ready && phys_addr / PAGE_SIZE >= PMM_DMA_LIMIT &&
+      phys_addr / PAGE_SIZE < pmm_total_pages)
+  {
+    // Only allocated pages that are not already cached may go in: a
+    // double free must not hand the page to two owners later.
+    phys_addr &= ~(uintptr_t)(PAGE_SIZE - 1);
+    size_t page = phys_addr / PAGE_SIZE;
+    uint64_t used = __atomic_load_n(&pmm_bitmap[page / WORD_BITS], __ATOMIC_ACQUIRE);
+    if (!(used & ((uint64_t)1 << (page % WORD_BITS))) || !pmm_cache_mark(phys_addr))
+      return; // double free
+    pmm_magazine_free(phys_addr);
+    return;
+  }
+
+  unsigned long flags = spin_lock_irqsave(&pmm_lock);
+  pmm_buddy_free(phys_addr, order);
+  spin_unlock_irqrestore(&pmm_lock, flags);
+}
+
+/* `align` is in pages; 0 and 1 both mean no alignment beyond a page. */
+static uintptr_t pmm_alloc_aligned_flags(size_t pages, size_t align, unsigned int flags)
+{
+  if (align <= 1)
+  {
+    align = 1;
+    if (pages == 1)
+      return pmm_alloc_order_flags(0, flags);
   }
 
-  return 0; // no suitable contiguous run found
+  unsigned long irqflags = spin_lock_irqsave(&pmm_lock);
+  uintptr_t phys = pmm_alloc_pages_locked(pages, align, flags);
+  spin_unlock_irqrestore(&pmm_lock, irqflags);
+
+  if (!phys && pmm_depot.full_count)
+  {
+    pmm_depot_flush();
+    irqflags = spin_lock_irqsave(&pmm_lock);
+    phys = pmm_alloc_pages_locked(pages, align, flags);
+    spin_unlock_irqrestore(&pmm_lock, irqflags);
+  }
+  return phys;
+}
+
+uintptr_t pmm_alloc_pages_flags(size_t pages, unsigned int flags)
+{
+  return pmm_alloc_aligned_flags(pages, 1, flags);
+}
+
+uintptr_t pmm_alloc_pages(size_t pages)
+{
+  return pmm_alloc_aligned_flags(pages, 1, PMM_DEFAULT);
+}
+
+uintptr_t pmm_alloc_aligned(size_t pages, size_t align)
+{
+  // Byte alignment to a power-of-two page count, at least one page.
+  if (align & (align - 1))
+    return 0;
+  align = align > PAGE_SIZE ? align / PAGE_SIZE : 1;
+  return pmm_alloc_aligned_flags(pages, align, PMM_DEFAULT);
 }
 
 void pmm_free_pages(uintptr_t phys_addr, size_t pages)
 {
-  if (pages == 0)
+  if (pages == 1)
+  {
+    pmm_free_order(phys_addr, 0);
     return;
+  }
 
-  size_t start_page = phys_addr / PAGE_SIZE;
+  unsigned long flags = spin_lock_irqsave(&pmm_lock);
+  pmm_free_pages_locked(phys_addr, pages);
+  spin_unlock_irqrestore(&pmm_lock, flags);
+}
 
-  for (size_t i = start_page; i < start_page + pages; i++)
+/* Debug view: check that the buddy lists and the bitmap agree. Every listed
+   block must be aligned and fully free in the bitmap, and the listed blocks
+   must account for every free page. */
+static bool pmm_check_locked(void)
+{
+  size_t listed = 0;
+  for (unsigned int zone = 0; zone < PMM_ZONES; zone++)
   {
-    if (i < pmm_total_pages)
-      BIT_CLEAR(i);
+    struct pmm_zone *z = &pmm_zones[zone];
+    size_t zone_pages = 0;
+    for (unsigned int o = 0; o <= PMM_MAX_ORDER; o++)
+    {
+      size_t count = 0;
+      for (struct pmm_free_block *b = z->free_area[o]; b; b = b->next)
+      {
+        size_t page = pmm_block_page(b);
+        size_t pages = (size_t)1 << o;
+        if (b->magic != PMM_FREE_MAGIC || b->order != o || b->zone != zone || (page & (pages - 1)))
+          return false;
+        if (pmm_free_run_end(page) < page + pages)
+          return false;
+        if (pmm_zone_of(page) != zone || pmm_zone_of(page + pages - 1) != zone)
+          return false;
+        zone_pages += pages;
+        count++;
+      }
+      if (count != z->free_count[o])
+        return false;
+    }
+    if (zone_pages != z->nr_free)
+      return false;
+    listed += zone_pages;
   }
+
+  size_t free_pages = 0;
+  for (size_t w = 0; w < pmm_bitmap_words; w++)
+    free_pages += WORD_BITS - __builtin_popcountll(pmm_bitmap[w]);
+  return free_pages == listed;
+}
+
+size_t pmm_deferred_init_step(size_t pages)
+{
+  unsigned long flags = spin_lock_irqsave(&pmm_lock);
+  size_t done = pmm_deferred_grow_locked(pages);
+  spin_unlock_irqrestore(&pmm_lock, flags);
+  return done;
+}
+
+void pmm_get_stats(struct pmm_stats *out)
+{
+  unsigned long flags = spin_lock_irqsave(&pmm_lock);
+  out->total_pages = pmm_total_pages;
+  out->usable_pages = pmm_usable_pages;
+  out->free_pages = pmm_nr_free;
+  for (unsigned int zone = 0; zone < PMM_ZONE_COUNT; zone++)
+  {
+    out->zone_free_pages[zone] = 0;
+    for (unsigned int node = 0; node < numa_node_count(); node++)
+      out->zone_free_pages[zone] += pmm_zones[node * PMM_ZONE_COUNT + zone].nr_free;
+  }
+  out->nodes = numa_node_count();
+  out->deferred_pages = pmm_deferred_pages;
+  out->init_cycles = pmm_init_cycles;
+  out->deferred_cycles = pmm_deferred_cycles;
+  out->huge_free = pmm_huge.nr_free;
+  out->huge_reserved = pmm_huge.reserved;
+  spin_unlock_irqrestore(&pmm_lock, flags);
+}
+
+bool pmm_check(void)
+{
+  unsigned long flags = spin_lock_irqsave(&pmm_lock);
+  bool ok = pmm_check_locked();
+  spin_unlock_irqrestore(&pmm_lock, flags);
+  return ok;
 }
\ No newline at end of file
@@ -1,37 +1,148 @@
 #include <kernel/psf/psf.h>
 #include <limine.h>
 
+#include <stdbool.h>
+
+#include <kernel/liballoc/liballoc.h>
+
+/* Glyphs are expanded ahead of time so drawing one is a few row copies
+   instead of a bit test and a store per pixel:
+
+   - the atlas holds the first PSF_ATLAS_GLYPHS glyphs as finished 32-bit
+     pixel rows in one fg/bg pair, chosen with psf_set_colors();
+   - any other pair goes through a table of the 256 possible glyph bytes,
+     each expanded to its 8 pixels, rebuilt when the pair changes. */
+
+// Two pixels at a time, through pointers the compiler knows alias uint32_t.
+typedef uint64_t __attribute__((__may_alias__)) pixel_pair;
+
+static PSF_font *font;
 static unsigned char *font_glyphs;
+static unsigned int bytesperline;
+
+static uint32_t *atlas; // glyph c starts at atlas + c * width * height
+static uint32_t atlas_fg, atlas_bg;
+static bool atlas_valid;
+
+static uint32_t spans[256][8];
+static uint32_t spans_fg, spans_bg;
+static bool spans_valid;
 
 void psf_init()
 {
-  PSF_font *font = (PSF_font *)&_binary_zap_ext_light32_psf_start;
-  font_glyphs = (char *)((unsigned char *)&_binary_zap_ext_light32_psf_start + font->headersize + font->numglyph * font->bytesperglyph);
+  font = (PSF_font *)_binary_zap_ext_light32_psf_start;
+  font_glyphs = (unsigned char *)_binary_zap_ext_light32_psf_start + font->headersize;
+  bytesperline = (font->width + 7) / 8;
 }
 
-void putc(struct limine_framebuffer *fb, char c, int cx, int cy, uint32_t fg, uint32_t bg)
+unsigned int psf_width(void)
+{
+  return font->width;
+}
+
+unsigned int psf_height(void)
 {
-  PSF_font *font = (PSF_font *)&_binary_zap_ext_light32_psf_start;
-  int bytesperline = (font->width + 7) / 8;
+  return font->height;
+}
+
+static inline const unsigned char *glyph_bits(unsigned int c)
+{
+  return font_glyphs + (c < font->numglyph ? c : 0) * font->bytesperglyph;
+}
 
-  unsigned char *glyph = (unsigned char *)&_binary_zap_ext_light32_psf_start + font->headersize + (c > 0 && c < font->numglyph ? c : 0) * font->bytesperglyph;
+static void build_spans(uint32_t fg, uint32_t bg)
+{
+  for (unsigned int b = 0; b < 256; b++)
+    for (unsigned int x = 0; x < 8; x++)
+      spans[b][x] = b & (0x80 >> x) ? fg : bg;
+  spans_fg = fg;
+  spans_bg = bg;
+  spans_valid = true;
+}
 
-  int offs =
-      (cy * font->height * (fb->pitch / 4)) +
-      (cx * (font->width + 1) * sizeof(uint32_t));
+/* Rows are stored most significant bit first, padded to whole bytes. */
+static void draw_spans(uint32_t *dst, size_t pitch, const unsigned char *glyph)
+{
+  // Locals: the pixel stores may alias the font header as far as the
+  // compiler knows.
+  unsigned int height = font->height, whole = font->width / 8, tail = font->width % 8;
+  unsigned int stride = bytesperline;
 
-  int x, y, line, mask;
-  for (y = 0; y < font->height; y++)
+  for (unsigned int y = 0; y < height; y++)
   {
-    line = offs;
-    mask = 1 << (font->width - 1);
-    for (x = 0; x < font->width; x++)
+    uint32_t *out = dst;
+    for (unsigned int b = 0; b < whole; b++, out += 8)
     {
-      *((uint32_t *)(fb + line)) = *((unsigned int *)glyph) & mask ? fg : bg;
-      mask >>= 1;
-      line += sizeof(uint32_t);
+      const uint32_t *span = spans[glyph[b]];
+      out[0] = span[0];
+      out[1] = span[1];
+      out[2] = span[2];
+      out[3] = span[3];
+      out[4] = span[4];
+      out[5] = span[5];
+      out[6] = span[6];
+      out[7] = span[7];
     }
-    glyph += bytesperline;
-    offs += (fb->pitch / 4);
+    for (unsigned int x = 0; x < tail; x++)
+      out[x] = spans[glyph[whole]][x];
+    glyph += stride;
+    dst += pitch;
   }
+}
+
+void psf_set_colors(uint32_t fg, uint32_t bg)
+{
+  if (atlas_valid && atlas_fg == fg && atlas_bg == bg)
+    return;
+
+  size_t glyph_pixels = (size_t)font->width * font->height;
+  if (!atlas)
+    atlas = malloc(PSF_ATLAS_GLYPHS * glyph_pixels * sizeof(uint32_t));
+  if (!atlas)
+    return;
+
+  // Lay each glyph out as if drawn into a buffer exactly one glyph wide.
+  build_spans(fg, bg);
+  for (unsigned int c = 0; c < PSF_ATLAS_GLYPHS; c++)
+    draw_spans(atlas + c * glyph_pixels, font->width, glyph_bits(c));
+  atlas_fg = fg;
+  atlas_bg = bg;
+  atlas_valid = true;
+}
+
+void psf_draw(uint32_t *dst, size_t pitch, unsigned int c, uint32_t fg, uint32_t bg)
+{
+  unsigned int width = font->width, height = font->height;
+
+  if (atlas_valid && c < PSF_ATLAS_GLYPHS && fg == atlas_fg && bg == atlas_bg)
+  {
+    const uint32_t *src = atlas + c * width * height;
+
+    // Two pixels per copy; the atlas is 8-byte aligned and rows are an
+    // even number of pixels whenever the width is.
+    if (width % 2 == 0 && ((uintptr_t)dst & 7) == 0 && pitch % 2 == 0)
+    {
+      for (unsigned int y = 0; y < height; y++, src += width, dst += pitch)
+        for (unsigned int w = 0; w < width / 2; w++)
+          ((pixel_pair *)dst)[w] = ((const pixel_pair *)src)[w];
+      return;
+    }
+
+    for (unsigned int y = 0; y < height; y++, src += width, dst += pitch)
+      for (unsigned int x = 0; x < width; x++)
+        dst[x] = src[x];
+    return;
+  }
+
+  if (!spans_valid || fg != spans_fg || bg != spans_bg)
+    build_spans(fg, bg);
+  draw_spans(dst, pitch, glyph_bits(c));
+}
+
+void putc(struct limine_framebuffer *fb, char c, int cx, int cy, uint32_t fg, uint32_t bg)
+{
+  size_t pitch = fb->pitch / 4;
+  uint32_t *dst = (uint32_t *)fb->address + cy * font->height * pitch + cx * font->width;
+
+  psf_draw(dst, pitch, (unsigned char)c, fg, bg);
 }
\ No newline at end of file
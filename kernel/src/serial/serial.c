@@ -0,0 +1,213 @@
+#include <kernel/serial/serial.h>
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include <kernel/cpu/cpu.h>
+
+/* ---- COM1 transmit ring ----
+   Writers reserve space by advancing `reserve` with a compare-and-swap,
+   copy their bytes in, then publish them by advancing `commit` in
+   reservation order (waiting for earlier writers, which run with
+   interrupts off so they always finish). One drainer at a time, picked by
+   `draining`, moves bytes in [sent, commit) to the UART. The counters run
+   freely and wrap; only their differences matter. */
+
+#define UART_DATA 0 // DLAB=0: transmit holding / receive buffer
+#define UART_IER 1  // DLAB=0: interrupt enable
+#define UART_DLL 0  // DLAB=1: divisor low byte
+#define UART_DLM 1  // DLAB=1: divisor high byte
+#define UART_FCR 2  // FIFO control (write)
+#define UART_IIR 2  // interrupt identification (read)
+#define UART_LCR 3
+#define UART_MCR 4
+#define UART_LSR 5
+
+#define LCR_8N1 0x03
+#define LCR_DLAB 0x80
+#define FCR_ENABLE 0x01
+#define FCR_CLEAR 0x06   // clear both FIFOs
+#define FCR_TRIGGER 0xc0 // receive interrupt at 14 bytes
+#define MCR_DTR_RTS_OUT2 0x0b
+#define MCR_LOOPBACK 0x10
+#define LSR_THRE 0x20 // transmit holding register (and FIFO) empty
+#define IIR_FIFO 0xc0 // both bits set: FIFOs enabled and working
+
+#define SERIAL_CHUNK 256 // bytes staged at a time by serial_write()
+
+static char ring[SERIAL_RING_SIZE];
+static uint32_t reserve; // bytes reserved by writers
+static uint32_t commit;  // bytes copied in and visible to the drainer
+static uint32_t sent;    // bytes handed to the UART
+static bool draining;
+
+static bool present;
+static unsigned int fifo_size = 1;
+
+#if defined(__x86_64__)
+
+static inline void outb(uint16_t port, uint8_t v)
+{
+  __asm__ __volatile__("outb %0, %1" ::"a"(v), "Nd"(port));
+}
+
+static inline uint8_t inb(uint16_t port)
+{
+  uint8_t v;
+  __asm__ __volatile__("inb %1, %0" : "=a"(v) : "Nd"(port));
+  return v;
+}
+
+bool serial_init(void)
+{
+  const uint16_t port = SERIAL_COM1;
+  const uint16_t divisor = 115200 / SERIAL_BAUD;
+
+  outb(port + UART_IER, 0);
+  outb(port + UART_LCR, LCR_DLAB);
+  outb(port + UART_DLL, divisor & 0xff);
+  outb(port + UART_DLM, divisor >> 8);
+  outb(port + UART_LCR, LCR_8N1);
+  outb(port + UART_FCR, FCR_ENABLE | FCR_CLEAR | FCR_TRIGGER);
+
+  // Anyone home? Send a byte to ourselves in loopback mode.
+  outb(port + UART_MCR, MCR_DTR_RTS_OUT2 | MCR_LOOPBACK);
+  outb(port + UART_DATA, 0xae);
+  if (inb(port + UART_DATA) != 0xae)
+    return false;
+  outb(port + UART_MCR, MCR_DTR_RTS_OUT2);
+
+  // A 16550A with working FIFOs takes 16 bytes per transmit-empty.
+  fifo_size = (inb(port + UART_IIR) & IIR_FIFO) == IIR_FIFO ? 16 : 1;
+  __atomic_store_n(&present, true, __ATOMIC_RELEASE);
+  return true;
+}
+
+/* Fill the FIFO once if it is empty. Returns false when the UART was
+   still busy or there was nothing to send. */
+static bool drain_once(void)
+{
+  uint32_t end = __atomic_load_n(&commit, __ATOMIC_ACQUIRE);
+  uint32_t from = sent;
+  if (from == end || !(inb(SERIAL_COM1 + UART_LSR) & LSR_THRE))
+    return false;
+
+  unsigned int n = end - from < fifo_size ? end - from : fifo_size;
+  for (unsigned int i = 0; i < n; i++)
+    outb(SERIAL_COM1 + UART_DATA, ring[(from + i) & (SERIAL_RING_SIZE - 1)]);
+  __atomic_store_n(&sent, from + n, __ATOMIC_RELEASE);
+  return true;
+}
+
+#else
+
+bool serial_init(void)
+{
+  return false;
+}
+
+static bool drain_once(void)
+{
+  return false;
+}
+
+#endif
+
+/* Become the drainer, or return false if another CPU is. */
+static inline bool drain_begin(void)
+{
+  return !__atomic_exchange_n(&draining, true, __ATOMIC_ACQUIRE);
+}
+
+static inline void drain_end(void)
+{
+  __atomic_store_n(&draining, false, __ATOMIC_RELEASE);
+}
+
+void serial_poll(void)
+{
+  if (!__atomic_load_n(&present, __ATOMIC_ACQUIRE) || !drain_begin())
+    return;
+  while (drain_once())
+    ;
+  drain_end();
+}
+
+void serial_irq(void)
+{
+  serial_poll();
+}
+
+void serial_flush(void)
+{
+  if (!__atomic_load_n(&present, __ATOMIC_ACQUIRE))
+    return;
+
+  while (__atomic_load_n(&sent, __ATOMIC_ACQUIRE) != __atomic_load_n(&commit, __ATOMIC_ACQUIRE))
+  {
+    if (drain_begin())
+    {
+      drain_once();
+      drain_end();
+    }
+    cpu_relax();
+  }
+}
+
+static void enqueue(const char *buf, uint32_t len)
+{
+  unsigned long flags = irq_save();
+  uint32_t start;
+
+  for (;;)
+  {
+    start = __atomic_load_n(&reserve, __ATOMIC_RELAXED);
+    if (start + len - __atomic_load_n(&sent, __ATOMIC_ACQUIRE) > SERIAL_RING_SIZE)
+    {
+      // Full: push some out ourselves rather than drop log output.
+      if (drain_begin())
+      {
+        drain_once();
+        drain_end();
+      }
+      cpu_relax();
+      continue;
+    }
+    if (__atomic_compare_exchange_n(&reserve, &start, start + len, false, __ATOMIC_ACQUIRE,
+                                    __ATOMIC_RELAXED))
+      break;
+  }
+
+  for (uint32_t i = 0; i < len; i++)
+    ring[(start + i) & (SERIAL_RING_SIZE - 1)] = buf[i];
+
+  // Publish in reservation order.
+  while (__atomic_load_n(&commit, __ATOMIC_ACQUIRE) != start)
+    cpu_relax();
+  __atomic_store_n(&commit, start + len, __ATOMIC_RELEASE);
+  irq_restore(flags);
+}
+
+void serial_write(const char *buf, size_t len)
+{
+  char chunk[SERIAL_CHUNK];
+  size_t n = 0;
+
+  if (!__atomic_load_n(&present, __ATOMIC_ACQUIRE))
+    return;
+
+  for (size_t i = 0; i < len; i++)
+  {
+    if (n >= sizeof(chunk) - 1)
+    {
+      enqueue(chunk, n);
+      n = 0;
+    }
+    if (buf[i] == '\n')
+      chunk[n++] = '\r';
+    chunk[n++] = buf[i];
+  }
+  if (n)
+    enqueue(chunk, n);
+}
@@ -0,0 +1,575 @@
+#include <kernel/slab/slab.h>
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include <kernel/cpu/cpu.h>
+#include <kernel/pmm/pmm.h>
+#include <kernel/spinlock/spinlock.h>
+
+/* ---- slab layer ----
+   A cache hands out fixed-size objects carved from slabs. A slab is one
+   naturally aligned 2^order page block from the PMM: a small header at the
+   front, then the objects. Free objects are chained through a pointer stored
+   inside the object itself, so a slab needs no other bookkeeping. Each new
+   slab starts its objects one cache line further in than the previous one
+   (colouring) while the slack at the end of the slab allows, so objects at
+   the same index in different slabs do not all compete for the same cache
+   sets. */
+#define SLAB_MAGIC 0x51abca5e
+#define SLAB_MAX_ORDER 3   // slabs are at most 8 pages
+#define SLAB_MIN_OBJECTS 8 // grow the slab order until at least this many fit
+#define SLAB_KEEP_EMPTY 1  // empty slabs a cache keeps before returning pages
+
+struct slab
+{
+  uint32_t magic;
+  uint32_t order;
+  struct kmem_cache *cache;
+  struct slab *next;
+  struct slab *prev;
+  void *free;         // first free object
+  unsigned int inuse; // objects handed out
+};
+
+struct kmem_cache
+{
+  spinlock_t lock;
+  const char *name;
+  size_t object_size;  // usable bytes per object
+  size_t size;         // stride between objects
+  size_t align;
+  size_t free_offset;  // where the free-list link lives inside an object
+  void (*ctor)(void *);
+  unsigned int order;
+  unsigned int objects; // objects per slab
+  size_t first;         // offset of the first object without colour
+  unsigned int colours; // distinct colour offsets the slab slack allows
+  unsigned int colour_next;
+  size_t colour_step;
+
+  // Slabs with some, no and all objects free.
+  struct slab *partial;
+  struct slab *full;
+  struct slab *empty;
+  size_t nr_slabs;
+  size_t nr_empty;
+  size_t active;
+
+  uint64_t allocs;
+  uint64_t frees;
+  uint64_t slabs_created;
+  uint64_t slabs_freed;
+
+  int cpu_class; // kmem_alloc() size class with a per-CPU front end, or -1
+};
+
+/* Caches are themselves objects of this bootstrap cache. */
+static struct kmem_cache slab_cache_cache;
+
+/* One bit per physical page, set on the first page of every slab. This is
+   what lets kmem_free() tell slab objects from other heap memory without a
+   header in front of every object. */
+static uint64_t *slab_heads;
+static size_t slab_total_pages;
+
+/* kmem_alloc() size classes: 16, 32, ... KMEM_MAX_SIZE bytes. */
+#define KMEM_MIN_SHIFT 4
+#define KMEM_CLASSES 8
+static const char *const kmem_class_names[KMEM_CLASSES] = {
+    "kmalloc-16", "kmalloc-32", "kmalloc-64", "kmalloc-128",
+    "kmalloc-256", "kmalloc-512", "kmalloc-1024", "kmalloc-2048"};
+static struct kmem_cache *kmem_classes[KMEM_CLASSES];
+static bool kmem_ready;
+
+/* ---- per-CPU front end ----
+   Each CPU keeps a small stack of free objects per size class. kmem_alloc()
+   and kmem_free() only touch the running CPU's stack with interrupts off and
+   take no lock; when a stack runs empty (or full) half a stack's worth of
+   objects moves from (or to) the class cache under its lock in one go.
+   Build with -DKMEM_CPU_CACHE=0 to send every request to the caches. */
+#ifndef KMEM_CPU_CACHE
+#define KMEM_CPU_CACHE 1
+#endif
+#define KMEM_CPU_MAX 16 // objects a CPU stack holds per class
+#define KMEM_CPU_BATCH (KMEM_CPU_MAX / 2)
+
+struct kmem_cpu
+{
+  unsigned int count[KMEM_CLASSES];
+  void *objs[KMEM_CLASSES][KMEM_CPU_MAX];
+  uint64_t hits;
+  uint64_t misses;
+} __cacheline_aligned;
+
+static struct kmem_cpu kmem_cpu[MAX_CPUS];
+
+static inline void slab_head_set(size_t page, bool set)
+{
+  uint64_t bit = (uint64_t)1 << (page % 64);
+  if (set)
+    __atomic_fetch_or(&slab_heads[page / 64], bit, __ATOMIC_RELAXED);
+  else
+    __atomic_fetch_and(&slab_heads[page / 64], ~bit, __ATOMIC_RELAXED);
+}
+
+static inline bool slab_head_test(size_t page)
+{
+  return __atomic_load_n(&slab_heads[page / 64], __ATOMIC_RELAXED) & ((uint64_t)1 << (page % 64));
+}
+
+static void slab_list_push(struct slab **list, struct slab *s)
+{
+  s->prev = NULL;
+  s->next = *list;
+  if (s->next)
+    s->next->prev = s;
+  *list = s;
+}
+
+static void slab_list_remove(struct slab **list, struct slab *s)
+{
+  if (s->prev)
+    s->prev->next = s->next;
+  else
+    *list = s->next;
+  if (s->next)
+    s->next->prev = s->prev;
+}
+
+static inline void **slab_link(const struct kmem_cache *cache, void *obj)
+{
+  return (void **)((char *)obj + cache->free_offset);
+}
+
+/* Work out object stride, slab order and colouring. Returns false if the
+   object cannot fit in a slab. */
+static bool slab_layout(struct kmem_cache *cache, size_t size, size_t align)
+{
+  if (size < sizeof(void *))
+    size = sizeof(void *);
+
+  if (align == 0)
+  {
+    if (size >= CACHE_LINE_SIZE)
+      align = CACHE_LINE_SIZE;
+    else
+    {
+      // Power-of-two strides below a line never straddle one.
+      align = sizeof(void *);
+      while (align < size)
+        align <<= 1;
+    }
+  }
+  if (align & (align - 1))
+    return false;
+  if (align < sizeof(void *))
+    align = sizeof(void *);
+
+  cache->object_size = size;
+  cache->align = align;
+
+  // A constructed object must survive being on the free list, so keep the
+  // link behind the object instead of on top of it.
+  cache->free_offset = 0;
+  if (cache->ctor)
+  {
+    cache->free_offset = align_up(size, sizeof(void *));
+    size = cache->free_offset + sizeof(void *);
+  }
+  cache->size = align_up(size, align);
+  cache->first = align_up(sizeof(struct slab), align);
+
+  for (cache->order = 0;; cache->order++)
+  {
+    size_t bytes = (size_t)PAGE_SIZE << cache->order;
+    cache->objects = bytes > cache->first ? (bytes - cache->first) / cache->size : 0;
+    if (cache->objects >= SLAB_MIN_OBJECTS || cache->order == SLAB_MAX_ORDER)
+      break;
+  }
+  if (cache->objects == 0)
+    return false;
+
+  size_t slack = ((size_t)PAGE_SIZE << cache->order) - cache->first - cache->objects * cache->size;
+  cache->colour_step = align > CACHE_LINE_SIZE ? align : CACHE_LINE_SIZE;
+  cache->colours = slack / cache->colour_step + 1;
+  cache->colour_next = 0;
+  return true;
+}
+
+static void slab_cache_init(struct kmem_cache *cache, const char *name, void (*ctor)(void *))
+{
+  memset(cache, 0, sizeof(*cache));
+  cache->lock = (spinlock_t)SPINLOCK_INIT;
+  cache->name = name;
+  cache->ctor = ctor;
+  cache->cpu_class = -1;
+}
+
+/* Get a fresh slab from the PMM and thread its objects onto the free list.
+   Caller holds cache->lock. */
+static struct slab *slab_grow(struct kmem_cache *cache)
+{
+  uintptr_t phys = pmm_alloc_order(cache->order);
+  if (!phys)
+    return NULL;
+
+  struct slab *s = phys_to_virt(phys);
+  s->magic = SLAB_MAGIC;
+  s->order = cache->order;
+  s->cache = cache;
+  s->inuse = 0;
+
+  char *base = (char *)s + cache->first + cache->colour_next * cache->colour_step;
+  if (++cache->colour_next == cache->colours)
+    cache->colour_next = 0;
+
+  // Link objects in address order so a fresh slab is handed out front to back.
+  s->free = NULL;
+  for (unsigned int i = cache->objects; i-- > 0;)
+  {
+    void *obj = base + i * cache->size;
+    if (cache->ctor)
+      cache->ctor(obj);
+    *slab_link(cache, obj) = s->free;
+    s->free = obj;
+  }
+
+  slab_head_set(phys / PAGE_SIZE, true);
+  cache->nr_slabs++;
+  cache->slabs_created++;
+  return s;
+}
+
+/* Caller holds cache->lock; s is already off every list. */
+static void slab_release(struct kmem_cache *cache, struct slab *s)
+{
+  uintptr_t phys = virt_to_phys(s);
+  slab_head_set(phys / PAGE_SIZE, false);
+  s->magic = 0;
+  cache->nr_slabs--;
+  cache->slabs_freed++;
+  pmm_free_order(phys, cache->order);
+}
+
+void kmem_init(void)
+{
+  struct pmm_stats st;
+  pmm_get_stats(&st);
+
+  size_t words = (st.total_pages + 63) / 64;
+  size_t pages = align_up(words * sizeof(uint64_t), PAGE_SIZE) / PAGE_SIZE;
+  uintptr_t phys = pmm_alloc_pages(pages);
+  if (!phys)
+    return;
+  slab_heads = phys_to_virt(phys);
+  memset(slab_heads, 0, pages * PAGE_SIZE);
+  slab_total_pages = st.total_pages;
+
+  slab_cache_init(&slab_cache_cache, "kmem_cache", NULL);
+  slab_layout(&slab_cache_cache, sizeof(struct kmem_cache), 0);
+
+  for (unsigned int i = 0; i < KMEM_CLASSES; i++)
+  {
+    kmem_classes[i] = kmem_cache_create(kmem_class_names[i], (size_t)1 << (i + KMEM_MIN_SHIFT), 0, NULL);
+    if (!kmem_classes[i])
+      return;
+    kmem_classes[i]->cpu_class = i;
+  }
+  kmem_ready = true;
+}
+
+struct kmem_cache *kmem_cache_create(const char *name, size_t size, size_t align, void (*ctor)(void *))
+{
+  if (!slab_heads || size == 0)
+    return NULL;
+
+  struct kmem_cache *cache = kmem_cache_alloc(&slab_cache_cache);
+  if (!cache)
+    return NULL;
+
+  slab_cache_init(cache, name, ctor);
+  if (!slab_layout(cache, size, align))
+  {
+    kmem_cache_free(&slab_cache_cache, cache);
+    return NULL;
+  }
+  return cache;
+}
+
+bool kmem_cache_destroy(struct kmem_cache *cache)
+{
+  unsigned long flags = spin_lock_irqsave(&cache->lock);
+  if (cache->active)
+  {
+    spin_unlock_irqrestore(&cache->lock, flags);
+    return false;
+  }
+  while (cache->empty)
+  {
+    struct slab *s = cache->empty;
+    slab_list_remove(&cache->empty, s);
+    slab_release(cache, s);
+  }
+  spin_unlock_irqrestore(&cache->lock, flags);
+
+  kmem_cache_free(&slab_cache_cache, cache);
+  return true;
+}
+
+/* Caller holds cache->lock. */
+static void *slab_alloc_locked(struct kmem_cache *cache)
+{
+  struct slab *s = cache->partial;
+  if (!s)
+  {
+    if ((s = cache->empty))
+    {
+      slab_list_remove(&cache->empty, s);
+      cache->nr_empty--;
+    }
+    else if (!(s = slab_grow(cache)))
+      return NULL;
+    slab_list_push(&cache->partial, s);
+  }
+
+  void *obj = s->free;
+  s->free = *slab_link(cache, obj);
+  if (++s->inuse == cache->objects)
+  {
+    slab_list_remove(&cache->partial, s);
+    slab_list_push(&cache->full, s);
+  }
+  cache->active++;
+  cache->allocs++;
+  return obj;
+}
+
+void *kmem_cache_alloc(struct kmem_cache *cache)
+{
+  unsigned long flags = spin_lock_irqsave(&cache->lock);
+  void *obj = slab_alloc_locked(cache);
+  spin_unlock_irqrestore(&cache->lock, flags);
+  return obj;
+}
+
+/* Caller holds cache->lock. */
+static void slab_free_locked(struct kmem_cache *cache, struct slab *s, void *obj)
+{
+  if (s->inuse == cache->objects)
+  {
+    slab_list_remove(&cache->full, s);
+    slab_list_push(&cache->partial, s);
+  }
+  *slab_link(cache, obj) = s->free;
+  s->free = obj;
+  cache->active--;
+  cache->frees++;
+
+  if (--s->inuse == 0)
+  {
+    slab_list_remove(&cache->partial, s);
+    if (cache->nr_empty < SLAB_KEEP_EMPTY)
+    {
+      slab_list_push(&cache->empty, s);
+      cache->nr_empty++;
+    }
+    else
+      slab_release(cache, s);
+  }
+}
+
+static void slab_free(struct kmem_cache *cache, struct slab *s, void *obj)
+{
+  unsigned long flags = spin_lock_irqsave(&cache->lock);
+  slab_free_locked(cache, s, obj);
+  spin_unlock_irqrestore(&cache->lock, flags);
+}
+
+static inline struct slab *slab_of(struct kmem_cache *cache, void *obj)
+{
+  uintptr_t head = align_down(virt_to_phys(obj), (uintptr_t)PAGE_SIZE << cache->order);
+  return phys_to_virt(head);
+}
+
+void kmem_cache_free(struct kmem_cache *cache, void *obj)
+{
+  if (!obj)
+    return;
+
+  // Slabs are naturally aligned blocks, so the header is found by masking.
+  slab_free(cache, slab_of(cache, obj), obj);
+}
+
+void kmem_cache_stats(struct kmem_cache *cache, struct kmem_cache_stats *out)
+{
+  unsigned long flags = spin_lock_irqsave(&cache->lock);
+  out->name = cache->name;
+  out->object_size = cache->size;
+  out->slab_order = cache->order;
+  out->slab_objects = cache->objects;
+  out->slabs = cache->nr_slabs;
+  out->active_objects = cache->active;
+  out->total_objects = cache->nr_slabs * cache->objects;
+  out->allocs = cache->allocs;
+  out->frees = cache->frees;
+  out->slabs_created = cache->slabs_created;
+  out->slabs_freed = cache->slabs_freed;
+  spin_unlock_irqrestore(&cache->lock, flags);
+}
+
+void kmem_class_usage(size_t *active_bytes, size_t *slab_bytes)
+{
+  *active_bytes = 0;
+  *slab_bytes = 0;
+  if (!kmem_ready)
+    return;
+
+  for (unsigned int i = 0; i < KMEM_CLASSES; i++)
+  {
+    struct kmem_cache_stats st;
+    kmem_cache_stats(kmem_classes[i], &st);
+    *active_bytes += st.active_objects * st.object_size;
+    *slab_bytes += st.slabs * ((size_t)PAGE_SIZE << st.slab_order);
+  }
+}
+
+void kmem_cpu_stats(uint64_t *hits, uint64_t *misses)
+{
+  *hits = 0;
+  *misses = 0;
+  for (unsigned int c = 0; c < MAX_CPUS; c++)
+  {
+    *hits += kmem_cpu[c].hits;
+    *misses += kmem_cpu[c].misses;
+  }
+}
+
+/* Find the slab an arbitrary kernel pointer lives in, or NULL. A slab of
+   order o starts at the pointer's page rounded down to 2^o pages; try each
+   order and check the candidate really covers the pointer. */
+static struct slab *slab_lookup(const void *ptr)
+{
+  if (!slab_heads || (uintptr_t)ptr < hhdm_offset())
+    return NULL;
+
+  size_t page = virt_to_phys(ptr) / PAGE_SIZE;
+  if (page >= slab_total_pages)
+    return NULL;
+
+  for (unsigned int o = 0; o <= SLAB_MAX_ORDER; o++)
+  {
+    size_t head = page & ~(((size_t)1 << o) - 1);
+    if (!slab_head_test(head))
+      continue;
+    struct slab *s = phys_to_virt(head * PAGE_SIZE);
+    if (s->magic == SLAB_MAGIC && page < head + ((size_t)1 << s->order))
+      return s;
+  }
+  return NULL;
+}
+
+/* Move up to KMEM_CPU_BATCH objects from the class cache to this CPU's
+   stack, which is empty. Interrupts are off. */
+static void kmem_cpu_refill(struct kmem_cpu *pc, unsigned int cls)
+{
+  struct kmem_cache *cache = kmem_classes[cls];
+  spin_lock(&cache->lock);
+  unsigned int n = 0;
+  while (n < KMEM_CPU_BATCH)
+  {
+    void *obj = slab_alloc_locked(cache);
+    if (!obj)
+      break;
+    pc->objs[cls][n++] = obj;
+  }
+  spin_unlock(&cache->lock);
+  pc->count[cls] = n;
+}
+
+/* Give the bottom KMEM_CPU_BATCH objects of this CPU's full stack back to
+   the class cache, keeping the most recently freed (cache-hot) ones.
+   Interrupts are off. */
+static void kmem_cpu_drain(struct kmem_cpu *pc, unsigned int cls)
+{
+  struct kmem_cache *cache = kmem_classes[cls];
+  spin_lock(&cache->lock);
+  for (unsigned int i = 0; i < KMEM_CPU_BATCH; i++)
+  {
+    void *obj = pc->objs[cls][i];
+    slab_free_locked(cache, slab_of(cache, obj), obj);
+  }
+  spin_unlock(&cache->lock);
+
+  pc->count[cls] -= KMEM_CPU_BATCH;
+  for (unsigned int i = 0; i < pc->count[cls]; i++)
+    pc->objs[cls][i] = pc->objs[cls][i + KMEM_CPU_BATCH];
+}
+
+void *kmem_alloc(size_t size)
+{
+  if (!kmem_ready || size > KMEM_MAX_SIZE)
+    return NULL;
+
+  unsigned int cls = 0;
+  if (size > ((size_t)1 << KMEM_MIN_SHIFT))
+    cls = (64 - __builtin_clzl(size - 1)) - KMEM_MIN_SHIFT;
+
+  if (!KMEM_CPU_CACHE)
+    return kmem_cache_alloc(kmem_classes[cls]);
+
+  unsigned long flags = irq_save();
+  struct kmem_cpu *pc = &kmem_cpu[cpu_id()];
+  if (pc->count[cls])
+    pc->hits++;
+  else
+  {
+    pc->misses++;
+    kmem_cpu_refill(pc, cls);
+  }
+  void *obj = pc->count[cls] ? pc->objs[cls][--pc->count[cls]] : NULL;
+  irq_restore(flags);
+  return obj;
+}
+
+void *kmem_alloc_aligned(size_t size, size_t align)
+{
+  if (align > CACHE_LINE_SIZE)
+    return NULL;
+  return kmem_alloc(size < align ? align : size);
+}
+
+bool kmem_free(void *ptr)
+{
+  struct slab *s = slab_lookup(ptr);
+  if (!s)
+    return false;
+
+  int cls = s->cache->cpu_class;
+  if (!KMEM_CPU_CACHE || cls < 0)
+  {
+    slab_free(s->cache, s, ptr);
+    return true;
+  }
+
+  unsigned long flags = irq_save();
+  struct kmem_cpu *pc = &kmem_cpu[cpu_id()];
+  if (pc->count[cls] == KMEM_CPU_MAX)
+  {
+    pc->misses++;
+    kmem_cpu_drain(pc, cls);
+  }
+  else
+    pc->hits++;
+  pc->objs[cls][pc->count[cls]++] = ptr;
+  irq_restore(flags);
+  return true;
+}
+
+size_t kmem_size(const void *ptr)
+{
+  struct slab *s = slab_lookup(ptr);
+  return s ? s->cache->object_size : 0;
+}
@@ -0,0 +1,149 @@
+#include <kernel/smp/smp.h>
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include <limine.h>
+
+#include <kernel/cpu/cpu.h>
+#include <kernel/klog/klog.h>
+#include <kernel/numa/numa.h>
+#include <kernel/pmm/pmm.h>
+
+/* Application processors come up through the Limine MP request: Limine
+   parks each one on a stack of its own until we write the address to jump
+   to into its limine_mp_info. We hand it its per-CPU block through
+   extra_argument; it installs the block, moves to the stack we gave it and
+   checks in by bumping `online`. */
+
+// How long smp_init() waits for the APs to check in before going on.
+#define SMP_WAIT_TICKS (1ull << 32)
+
+__attribute__((used, section(".limine_requests"))) static volatile struct limine_mp_request mp_req = {
+    .id = LIMINE_MP_REQUEST,
+    .revision = 0,
+#if defined(__x86_64__)
+    .flags = LIMINE_MP_X2APIC,
+#endif
+};
+
+static struct cpu_local cpus[MAX_CPUS];
+static unsigned int online = 1;
+static void (*ap_entry)(void);
+
+void smp_init_bsp(void)
+{
+  cpus[0].id = 0;
+  cpu_local_install(&cpus[0]);
+}
+
+unsigned int smp_cpu_count(void)
+{
+  return __atomic_load_n(&online, __ATOMIC_ACQUIRE);
+}
+
+struct cpu_local *smp_cpu(unsigned int id)
+{
+  return id < MAX_CPUS ? &cpus[id] : NULL;
+}
+
+/* Runs on the AP's own stack. */
+__attribute__((noreturn)) static void ap_main(struct cpu_local *c)
+{
+  numa_register_cpu(c->id, c->hw_id);
+  c->node = numa_cpu_node(c->id);
+  __atomic_fetch_add(&online, 1, __ATOMIC_RELEASE);
+  klog("smp: cpu %u (hw id %llu) up on node %u\n", c->id, (unsigned long long)c->hw_id, c->node);
+  ap_entry();
+  __builtin_unreachable();
+}
+
+/* Limine's jump target; still on the stack Limine gave the AP. */
+static void ap_start(struct limine_mp_info *info)
+{
+  struct cpu_local *c = (struct cpu_local *)(uintptr_t)info->extra_argument;
+  cpu_local_install(c);
+
+#if defined(__x86_64__)
+  __asm__ __volatile__("movq %0, %%rsp\n\t"
+                       "xorl %%ebp, %%ebp\n\t"
+                       "call *%1\n\t"
+                       "ud2" ::"r"(c->stack_top),
+                       "r"(ap_main), "D"(c)
+                       : "memory");
+#elif defined(__aarch64__)
+  __asm__ __volatile__("mov sp, %0\n\t"
+                       "mov x29, xzr\n\t"
+                       "mov x0, %2\n\t"
+                       "blr %1" ::"r"(c->stack_top),
+                       "r"(ap_main), "r"(c)
+                       : "x0", "x29", "x30", "memory");
+#elif defined(__riscv)
+  __asm__ __volatile__("mv sp, %0\n\t"
+                       "mv a0, %2\n\t"
+                       "jalr %1" ::"r"(c->stack_top),
+                       "r"(ap_main), "r"(c)
+                       : "a0", "ra", "memory");
+#elif defined(__loongarch64)
+  __asm__ __volatile__("move $sp, %0\n\t"
+                       "move $a0, %2\n\t"
+                       "jirl $ra, %1, 0" ::"r"(c->stack_top),
+                       "r"(ap_main), "r"(c)
+                       : "$a0", "$ra", "memory");
+#endif
+  __builtin_unreachable();
+}
+
+unsigned int smp_init(void (*entry)(void))
+{
+  struct limine_mp_response *mp = mp_req.response;
+  if (!mp)
+    return 1;
+
+#if defined(__x86_64__)
+  uint64_t bsp_hw_id = mp->bsp_lapic_id;
+#else
+  uint64_t bsp_hw_id = mp->bsp_mpidr;
+#endif
+  cpus[0].hw_id = bsp_hw_id;
+  numa_register_cpu(0, bsp_hw_id);
+  cpus[0].node = numa_cpu_node(0);
+
+  ap_entry = entry;
+  unsigned int started = 1;
+  for (uint64_t i = 0; i < mp->cpu_count && started < MAX_CPUS; i++)
+  {
+    struct limine_mp_info *info = mp->cpus[i];
+#if defined(__x86_64__)
+    uint64_t hw_id = info->lapic_id;
+#else
+    uint64_t hw_id = info->mpidr;
+#endif
+    if (hw_id == bsp_hw_id)
+      continue;
+
+    uintptr_t stack = pmm_alloc_pages(SMP_STACK_PAGES);
+    if (!stack)
+    {
+      klog("smp: no memory for a stack, %u cpus started\n", started);
+      break;
+    }
+
+    struct cpu_local *c = &cpus[started];
+    c->id = started;
+    c->hw_id = hw_id;
+    c->stack_top = (char *)phys_to_virt(stack) + SMP_STACK_PAGES * PAGE_SIZE;
+    info->extra_argument = (uintptr_t)c;
+    // Writing goto_address is what releases the AP.
+    __atomic_store_n(&info->goto_address, ap_start, __ATOMIC_RELEASE);
+    started++;
+  }
+  if (mp->cpu_count > MAX_CPUS)
+    klog("smp: %llu cpus, only %u supported\n", (unsigned long long)mp->cpu_count, MAX_CPUS);
+
+  uint64_t t0 = cpu_timestamp();
+  while (smp_cpu_count() < started && cpu_timestamp() - t0 < SMP_WAIT_TICKS)
+    cpu_relax();
+  return smp_cpu_count();
+}
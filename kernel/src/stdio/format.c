@@ -0,0 +1,321 @@
+#include <kernel/stdio/kstdio.h>
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include <string.h>
+
+/* The formatting engine behind kprintf(). It only ever writes into the
+   caller's buffer: literal runs and strings are copied whole, integers are
+   built backwards in a small stack buffer, decimal two digits per division
+   from a digit-pair table and hex a nibble at a time from a lookup. */
+
+static const char digit_pairs[201] = "00010203040506070809"
+                                     "10111213141516171819"
+                                     "20212223242526272829"
+                                     "30313233343536373839"
+                                     "40414243444546474849"
+                                     "50515253545556575859"
+                                     "60616263646566676869"
+                                     "70717273747576777879"
+                                     "80818283848586878889"
+                                     "90919293949596979899";
+
+static const char hex_lower[16] = "0123456789abcdef";
+static const char hex_upper[16] = "0123456789ABCDEF";
+
+#define FLAG_LEFT 0x01  // '-'
+#define FLAG_ZERO 0x02  // '0'
+#define FLAG_PLUS 0x04  // '+'
+#define FLAG_SPACE 0x08 // ' '
+#define FLAG_ALT 0x10   // '#'
+
+struct sink
+{
+  char *p;
+  char *end; // one before the end of the buffer: room for the NUL
+  size_t total;
+};
+
+/* Most pieces are a few bytes, cheaper to copy inline than to call out
+   for; the kernel is built freestanding, so memcpy() is never inlined. */
+#define SMALL_COPY 16
+
+static inline void put(struct sink *s, const char *src, size_t n)
+{
+  size_t room = s->end - s->p;
+  size_t k = n < room ? n : room;
+  if (k < SMALL_COPY)
+    for (size_t i = 0; i < k; i++)
+      s->p[i] = src[i];
+  else
+    memcpy(s->p, src, k);
+  s->p += k;
+  s->total += n;
+}
+
+static inline void pad(struct sink *s, char c, size_t n)
+{
+  if (!n)
+    return;
+  size_t room = s->end - s->p;
+  size_t k = n < room ? n : room;
+  memset(s->p, c, k);
+  s->p += k;
+  s->total += n;
+}
+
+/* Write v in decimal ending just before `end`; returns the first digit. */
+static inline char *dec_digits(char *end, uint64_t v)
+{
+  while (v >= 100)
+  {
+    unsigned int r = v % 100;
+    v /= 100;
+    end -= 2;
+    __builtin_memcpy(end, &digit_pairs[2 * r], 2);
+  }
+  if (v >= 10)
+  {
+    end -= 2;
+    __builtin_memcpy(end, &digit_pairs[2 * v], 2);
+  }
+  else
+    *--end = '0' + v;
+  return end;
+}
+
+static inline char *hex_digits(char *end, uint64_t v, const char *digits)
+{
+  do
+  {
+    *--end = digits[v & 15];
+    v >>= 4;
+  } while (v);
+  return end;
+}
+
+/* Lay out a converted number: [spaces][prefix][zeros]digits[spaces]. */
+static void put_number(struct sink *s, const char *prefix, size_t prefix_len, const char *digits,
+                       size_t len, unsigned int flags, int width, int precision)
+{
+  size_t zeros = precision > 0 && (size_t)precision > len ? precision - len : 0;
+  size_t body = prefix_len + zeros + len;
+  size_t fill = width > 0 && (size_t)width > body ? width - body : 0;
+
+  if ((flags & FLAG_ZERO) && !(flags & FLAG_LEFT) && precision < 0)
+  {
+    zeros += fill;
+    fill = 0;
+  }
+  if (!(flags & FLAG_LEFT))
+    pad(s, ' ', fill);
+  put(s, prefix, prefix_len);
+  pad(s, '0', zeros);
+  put(s, digits, len);
+  if (flags & FLAG_LEFT)
+    pad(s, ' ', fill);
+}
+
+/* Lay out text: [spaces]text[spaces]. */
+static void put_field(struct sink *s, const char *str, size_t len, unsigned int flags, int width)
+{
+  size_t fill = width > 0 && (size_t)width > len ? width - len : 0;
+
+  if (!(flags & FLAG_LEFT))
+    pad(s, ' ', fill);
+  put(s, str, len);
+  if (flags & FLAG_LEFT)
+    pad(s, ' ', fill);
+}
+
+int kvsnprintf(char *buf, size_t size, const char *fmt, va_list ap)
+{
+  char scratch;
+  struct sink s = {buf, buf + size - 1, 0};
+  if (size == 0)
+    s.p = s.end = &scratch;
+
+  for (;;)
+  {
+    // Copy the literal text up to the next conversion as it is scanned.
+    const char *run = fmt;
+    char *p = s.p;
+    while (*fmt && *fmt != '%' && p < s.end)
+      *p++ = *fmt++;
+    s.p = p;
+    while (*fmt && *fmt != '%')
+      fmt++;
+    s.total += fmt - run;
+    if (!*fmt)
+      break;
+    const char *spec = fmt++;
+
+    unsigned int flags = 0;
+    for (;; fmt++)
+    {
+      if (*fmt == '-')
+        flags |= FLAG_LEFT;
+      else if (*fmt == '0')
+        flags |= FLAG_ZERO;
+      else if (*fmt == '+')
+        flags |= FLAG_PLUS;
+      else if (*fmt == ' ')
+        flags |= FLAG_SPACE;
+      else if (*fmt == '#')
+        flags |= FLAG_ALT;
+      else
+        break;
+    }
+
+    int width = 0;
+    if (*fmt == '*')
+    {
+      width = va_arg(ap, int);
+      if (width < 0)
+      {
+        flags |= FLAG_LEFT;
+        width = -width;
+      }
+      fmt++;
+    }
+    else
+      while (*fmt >= '0' && *fmt <= '9')
+        width = width * 10 + (*fmt++ - '0');
+
+    int precision = -1;
+    if (*fmt == '.')
+    {
+      fmt++;
+      precision = 0;
+      if (*fmt == '*')
+      {
+        precision = va_arg(ap, int);
+        fmt++;
+      }
+      else
+        while (*fmt >= '0' && *fmt <= '9')
+          precision = precision * 10 + (*fmt++ - '0');
+    }
+
+    // Length: count of 'l's, or -1/-2 for h/hh; z, t and j are as wide as long.
+    int length = 0;
+    for (;; fmt++)
+    {
+      if (*fmt == 'l')
+        length++;
+      else if (*fmt == 'h')
+        length--;
+      else if (*fmt == 'z' || *fmt == 't' || *fmt == 'j')
+        length = 1;
+      else
+        break;
+    }
+
+    char tmp[24];
+    char *end = tmp + sizeof(tmp);
+    char *digits;
+    char prefix[2];
+    size_t prefix_len = 0;
+    uint64_t u;
+
+    switch (*fmt)
+    {
+    case 'c':
+      tmp[0] = (char)va_arg(ap, int);
+      put_field(&s, tmp, 1, flags, width);
+      break;
+    case 's':
+    {
+      const char *str = va_arg(ap, const char *);
+      if (!str)
+        str = "(null)";
+      put_field(&s, str, precision >= 0 ? strnlen(str, precision) : strlen(str), flags, width);
+      break;
+    }
+    case 'd':
+    case 'i':
+    {
+      int64_t v;
+      if (length >= 2)
+        v = va_arg(ap, long long);
+      else if (length == 1)
+        v = va_arg(ap, long);
+      else if (length == -1)
+        v = (short)va_arg(ap, int);
+      else if (length <= -2)
+        v = (signed char)va_arg(ap, int);
+      else
+        v = va_arg(ap, int);
+      u = v < 0 ? -(uint64_t)v : (uint64_t)v;
+      if (v < 0)
+        prefix[prefix_len++] = '-';
+      else if (flags & FLAG_PLUS)
+        prefix[prefix_len++] = '+';
+      else if (flags & FLAG_SPACE)
+        prefix[prefix_len++] = ' ';
+      digits = precision == 0 && u == 0 ? end : dec_digits(end, u);
+      put_number(&s, prefix, prefix_len, digits, end - digits, flags, width, precision);
+      break;
+    }
+    case 'u':
+    case 'x':
+    case 'X':
+    case 'p':
+      if (*fmt == 'p')
+      {
+        u = (uintptr_t)va_arg(ap, void *);
+        flags |= FLAG_ALT;
+      }
+      else if (length >= 2)
+        u = va_arg(ap, unsigned long long);
+      else if (length == 1)
+        u = va_arg(ap, unsigned long);
+      else if (length == -1)
+        u = (unsigned short)va_arg(ap, unsigned int);
+      else if (length <= -2)
+        u = (unsigned char)va_arg(ap, unsigned int);
+      else
+        u = va_arg(ap, unsigned int);
+
+      if (precision == 0 && u == 0)
+        digits = end;
+      else if (*fmt == 'u')
+        digits = dec_digits(end, u);
+      else
+        digits = hex_digits(end, u, *fmt == 'X' ? hex_upper : hex_lower);
+      if ((flags & FLAG_ALT) && *fmt != 'u' && (u || *fmt == 'p'))
+      {
+        prefix[prefix_len++] = '0';
+        prefix[prefix_len++] = *fmt == 'X' ? 'X' : 'x';
+      }
+      put_number(&s, prefix, prefix_len, digits, end - digits, flags, width, precision);
+      break;
+    case '%':
+      put(&s, "%", 1);
+      break;
+    case '\0':
+      // A lone '%' at the end: show it and stop.
+      put(&s, spec, 1);
+      fmt--;
+      break;
+    default:
+      // Unknown conversion: show it as written.
+      put(&s, spec, fmt + 1 - spec);
+    }
+    fmt++;
+  }
+
+  *s.p = '\0';
+  return s.total > INT32_MAX ? -1 : (int)s.total;
+}
+
+int ksnprintf(char *buf, size_t size, const char *fmt, ...)
+{
+  va_list ap;
+  va_start(ap, fmt);
+  int n = kvsnprintf(buf, size, fmt, ap);
+  va_end(ap);
+  return n;
+}
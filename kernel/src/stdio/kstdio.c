@@ -0,0 +1,61 @@
+#include <kernel/stdio/kstdio.h>
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdarg.h>
+#include <string.h>
+
+#include <kernel/console/console.h>
+#include <kernel/cpu/cpu.h>
+#include <kernel/serial/serial.h>
+
+/* kprintf() formats the whole message into this CPU's buffer with
+   interrupts off, hands it to both sinks, the console and COM1, in one
+   write each, then ends with one console_flush_soon() and one
+   serial_poll(). */
+static char kprintf_bufs[MAX_CPUS][KPRINTF_MAX] __cacheline_aligned;
+
+static void write_sinks(const char *buf, size_t len)
+{
+  console_write(buf, len);
+  serial_write(buf, len);
+}
+
+static void kick_sinks(void)
+{
+  console_flush_soon();
+  serial_poll();
+}
+
+void kwrite(const char *buf, size_t len)
+{
+  write_sinks(buf, len);
+  kick_sinks();
+}
+
+void kputs(const char *s)
+{
+  kwrite(s, strlen(s));
+}
+
+int kvprintf(const char *fmt, va_list ap)
+{
+  unsigned long flags = irq_save();
+  char *buf = kprintf_bufs[cpu_id()];
+  int n = kvsnprintf(buf, KPRINTF_MAX, fmt, ap);
+  if (n > 0)
+    write_sinks(buf, n < KPRINTF_MAX ? (size_t)n : KPRINTF_MAX - 1);
+  irq_restore(flags);
+
+  kick_sinks();
+  return n;
+}
+
+int kprintf(const char *fmt, ...)
+{
+  va_list ap;
+  va_start(ap, fmt);
+  int n = kvprintf(fmt, ap);
+  va_end(ap);
+  return n;
+}
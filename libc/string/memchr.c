@@ -0,0 +1,32 @@
+#include <string.h>
+#include <stdint.h>
+
+#include "swar.h"
+
+void *memchr(const void *s, int c, size_t n)
+{
+  const uint8_t *p = (const uint8_t *)s;
+  uint8_t ch = (uint8_t)c;
+
+  for (; n && ((uintptr_t)p & 7); n--, p++)
+  {
+    if (*p == ch)
+      return (void *)p;
+  }
+
+  uint64_t pattern = swar_repeat(ch);
+  for (; n >= 8; n -= 8, p += 8)
+  {
+    uint64_t hit = swar_zero(*(const swar_word *)p ^ pattern);
+    if (hit)
+      return (void *)(p + swar_first(hit));
+  }
+
+  for (; n; n--, p++)
+  {
+    if (*p == ch)
+      return (void *)p;
+  }
+
+  return NULL;
+}
\ No newline at end of file
@@ -1,18 +1,37 @@
 #include <string.h>
 #include <stdint.h>
 
+#include "swar.h"
+
 int memcmp(const void *s1, const void *s2, size_t n)
 {
   const uint8_t *p1 = (const uint8_t *)s1;
   const uint8_t *p2 = (const uint8_t *)s2;
 
-  for (size_t i = 0; i < n; i++)
+  for (; n && ((uintptr_t)p1 & 7); n--, p1++, p2++)
+  {
+    if (*p1 != *p2)
+      return *p1 < *p2 ? -1 : 1;
+  }
+
+  if (SWAR_UNALIGNED || ((uintptr_t)p2 & 7) == 0)
   {
-    if (p1[i] != p2[i])
+    for (; n >= 8; n -= 8, p1 += 8, p2 += 8)
     {
-      return p1[i] < p2[i] ? -1 : 1;
+      uint64_t diff = *(const swar_word *)p1 ^ *(const swar_uword *)p2;
+      if (diff)
+      {
+        unsigned int i = swar_first(diff);
+        return p1[i] < p2[i] ? -1 : 1;
+      }
     }
   }
 
+  for (; n; n--, p1++, p2++)
+  {
+    if (*p1 != *p2)
+      return *p1 < *p2 ? -1 : 1;
+  }
+
   return 0;
 }
\ No newline at end of file
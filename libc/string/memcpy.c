@@ -1,15 +1,24 @@
 #include <string.h>
 #include <stdint.h>
 
+#include "memops.h"
+
+unsigned int memops_cpu_features;
+
 void *memcpy(void *restrict dest, const void *restrict src, size_t n)
 {
-  uint8_t *restrict pdest = (uint8_t *restrict)dest;
-  const uint8_t *restrict psrc = (const uint8_t *restrict)src;
-
-  for (size_t i = 0; i < n; i++)
+#if defined(__x86_64__)
+  int bytewise;
+  if (memops_use_rep(n, &bytewise))
   {
-    pdest[i] = psrc[i];
+    if (bytewise)
+      memops_movsb(dest, src, n);
+    else
+      memops_movsq(dest, src, n);
+    return dest;
   }
+#endif
 
+  memops_copy_words((uint8_t *)dest, (const uint8_t *)src, n);
   return dest;
 }
\ No newline at end of file
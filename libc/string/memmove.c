@@ -1,24 +1,24 @@
 #include <string.h>
 #include <stdint.h>
 
+#include "memops.h"
+
 void *memmove(void *dest, const void *src, size_t n)
 {
   uint8_t *pdest = (uint8_t *)dest;
   const uint8_t *psrc = (const uint8_t *)src;
 
-  if (src > dest)
+  // Disjoint buffers are an ordinary copy, rep string paths included.
+  if ((uintptr_t)pdest - (uintptr_t)psrc >= n && (uintptr_t)psrc - (uintptr_t)pdest >= n)
+    return memcpy(dest, src, n);
+
+  if (psrc > pdest)
   {
-    for (size_t i = 0; i < n; i++)
-    {
-      pdest[i] = psrc[i];
-    }
+    memops_copy_words(pdest, psrc, n);
   }
-  else if (src < dest)
+  else if (psrc < pdest)
   {
-    for (size_t i = n; i > 0; i--)
-    {
-      pdest[i - 1] = psrc[i - 1];
-    }
+    memops_copy_words_backward(pdest, psrc, n);
   }
 
   return dest;
@@ -0,0 +1,230 @@
+#ifndef _MEMOPS_H
+#define _MEMOPS_H 1
+
+/* Building blocks for memcpy, memset and memmove. Internal to libc/string;
+   the host benchmark includes it to time each variant on its own.
+
+   The word loops align the destination to 8 bytes with single bytes, move
+   four words per iteration, then finish with words and bytes. x86_64 loads
+   misaligned words from the source; other architectures take the word loop
+   only when source and destination share their alignment, and fall back to
+   bytes otherwise. On x86_64, longer runs go to `rep movsb`/`rep stosb`
+   when CPUID reports ERMS (or FSRM, which also makes short runs cheap), and
+   to `rep movsq`/`rep stosq` otherwise. */
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define MEMOPS_ERMS (1u << 0)    // enhanced rep movsb/stosb
+#define MEMOPS_FSRM (1u << 1)    // fast short rep movsb
+#define MEMOPS_PROBED (1u << 31) // features have been read
+
+// Runs this long go to the rep string instructions; with FSRM, from
+// MEMOPS_FSRM_MIN. Shorter ones stay in the word loops.
+#define MEMOPS_REP_MIN 512
+#define MEMOPS_FSRM_MIN 64
+
+typedef uint64_t __attribute__((__may_alias__)) memops_word;
+#if defined(__x86_64__)
+#define MEMOPS_UNALIGNED 1
+typedef uint64_t __attribute__((__may_alias__, __aligned__(1))) memops_src_word;
+#else
+#define MEMOPS_UNALIGNED 0
+typedef memops_word memops_src_word;
+#endif
+
+extern unsigned int memops_cpu_features;
+
+static inline unsigned int memops_probe(void)
+{
+  unsigned int features = MEMOPS_PROBED;
+#if defined(__x86_64__)
+  uint32_t eax, ebx, ecx, edx;
+
+  __asm__("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(0), "c"(0));
+  if (eax >= 7)
+  {
+    __asm__("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(7), "c"(0));
+    if (ebx & (1u << 9))
+      features |= MEMOPS_ERMS;
+    if (edx & (1u << 4))
+      features |= MEMOPS_FSRM;
+  }
+#endif
+  return features;
+}
+
+/* CPU string-instruction features, read once. Racing first callers just
+   probe twice. */
+static inline unsigned int memops_features(void)
+{
+  unsigned int features = memops_cpu_features;
+  if (__builtin_expect(features == 0, 0))
+    memops_cpu_features = features = memops_probe();
+  return features;
+}
+
+static inline void memops_copy_bytes(unsigned char *d, const unsigned char *s, size_t n)
+{
+  for (size_t i = 0; i < n; i++)
+  {
+    d[i] = s[i];
+  }
+}
+
+/* Forward word copy. Every word is loaded before the store that could
+   overlap it, so it also serves memmove when dest is below src. */
+static inline void memops_copy_words(unsigned char *d, const unsigned char *s, size_t n)
+{
+  if (n >= 16 && (MEMOPS_UNALIGNED || (((uintptr_t)d ^ (uintptr_t)s) & 7) == 0))
+  {
+    while ((uintptr_t)d & 7)
+    {
+      *d++ = *s++;
+      n--;
+    }
+    for (; n >= 32; n -= 32, d += 32, s += 32)
+    {
+      memops_word w0 = ((const memops_src_word *)s)[0];
+      memops_word w1 = ((const memops_src_word *)s)[1];
+      memops_word w2 = ((const memops_src_word *)s)[2];
+      memops_word w3 = ((const memops_src_word *)s)[3];
+      ((memops_word *)d)[0] = w0;
+      ((memops_word *)d)[1] = w1;
+      ((memops_word *)d)[2] = w2;
+      ((memops_word *)d)[3] = w3;
+    }
+    for (; n >= 8; n -= 8, d += 8, s += 8)
+    {
+      *(memops_word *)d = *(const memops_src_word *)s;
+    }
+  }
+  memops_copy_bytes(d, s, n);
+}
+
+/* Backward word copy for memmove when dest is above src: the top is moved
+   first, so nothing is overwritten before it has been read. */
+static inline void memops_copy_words_backward(unsigned char *d, const unsigned char *s, size_t n)
+{
+  d += n;
+  s += n;
+  if (n >= 16 && (MEMOPS_UNALIGNED || (((uintptr_t)d ^ (uintptr_t)s) & 7) == 0))
+  {
+    while ((uintptr_t)d & 7)
+    {
+      *--d = *--s;
+      n--;
+    }
+    for (; n >= 32; n -= 32)
+    {
+      d -= 32;
+      s -= 32;
+      memops_word w3 = ((const memops_src_word *)s)[3];
+      memops_word w2 = ((const memops_src_word *)s)[2];
+      memops_word w1 = ((const memops_src_word *)s)[1];
+      memops_word w0 = ((const memops_src_word *)s)[0];
+      ((memops_word *)d)[3] = w3;
+      ((memops_word *)d)[2] = w2;
+      ((memops_word *)d)[1] = w1;
+      ((memops_word *)d)[0] = w0;
+    }
+    for (; n >= 8; n -= 8)
+    {
+      d -= 8;
+      s -= 8;
+      *(memops_word *)d = *(const memops_src_word *)s;
+    }
+  }
+  while (n--)
+  {
+    *--d = *--s;
+  }
+}
+
+static inline void memops_set_bytes(unsigned char *d, unsigned char c, size_t n)
+{
+  for (size_t i = 0; i < n; i++)
+  {
+    d[i] = c;
+  }
+}
+
+static inline void memops_set_words(unsigned char *d, unsigned char c, size_t n)
+{
+  if (n >= 16)
+  {
+    memops_word w = (memops_word)c * 0x0101010101010101ull;
+    while ((uintptr_t)d & 7)
+    {
+      *d++ = c;
+      n--;
+    }
+    for (; n >= 32; n -= 32, d += 32)
+    {
+      ((memops_word *)d)[0] = w;
+      ((memops_word *)d)[1] = w;
+      ((memops_word *)d)[2] = w;
+      ((memops_word *)d)[3] = w;
+    }
+    for (; n >= 8; n -= 8, d += 8)
+    {
+      *(memops_word *)d = w;
+    }
+  }
+  memops_set_bytes(d, c, n);
+}
+
+#if defined(__x86_64__)
+static inline void memops_movsb(void *d, const void *s, size_t n)
+{
+  __asm__ __volatile__("rep movsb" : "+D"(d), "+S"(s), "+c"(n) : : "memory");
+}
+
+/* Word moves go slowly when they straddle lines, so the destination is
+   aligned with single bytes first. For runs of at least 8 bytes. */
+static inline void memops_movsq(void *d, const void *s, size_t n)
+{
+  size_t head = -(uintptr_t)d & 7;
+  size_t words = (n - head) / 8;
+  size_t tail = (n - head) & 7;
+  __asm__ __volatile__("rep movsb" : "+D"(d), "+S"(s), "+c"(head) : : "memory");
+  __asm__ __volatile__("rep movsq" : "+D"(d), "+S"(s), "+c"(words) : : "memory");
+  __asm__ __volatile__("rep movsb" : "+D"(d), "+S"(s), "+c"(tail) : : "memory");
+}
+
+static inline void memops_stosb(void *d, unsigned char c, size_t n)
+{
+  __asm__ __volatile__("rep stosb" : "+D"(d), "+c"(n) : "a"(c) : "memory");
+}
+
+/* As memops_movsq(), for runs of at least 8 bytes. */
+static inline void memops_stosq(void *d, unsigned char c, size_t n)
+{
+  size_t head = -(uintptr_t)d & 7;
+  size_t words = (n - head) / 8;
+  size_t tail = (n - head) & 7;
+  uint64_t w = c * 0x0101010101010101ull;
+  __asm__ __volatile__("rep stosb" : "+D"(d), "+c"(head) : "a"(w) : "memory");
+  __asm__ __volatile__("rep stosq" : "+D"(d), "+c"(words) : "a"(w) : "memory");
+  __asm__ __volatile__("rep stosb" : "+D"(d), "+c"(tail) : "a"(w) : "memory");
+}
+
+/* Whether a run of `n` bytes should use the rep string instructions, and
+   the byte-granular ones at that. */
+static inline int memops_use_rep(size_t n, int *bytewise)
+{
+  if (n < MEMOPS_FSRM_MIN)
+    return 0;
+
+  unsigned int features = memops_features();
+  if (features & MEMOPS_FSRM)
+  {
+    *bytewise = 1;
+    return 1;
+  }
+  *bytewise = (features & MEMOPS_ERMS) != 0;
+  return n >= MEMOPS_REP_MIN;
+}
+#endif
+
+#endif
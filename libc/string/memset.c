@@ -1,14 +1,22 @@
 #include <string.h>
 #include <stdint.h>
 
+#include "memops.h"
+
 void *memset(void *s, int c, size_t n)
 {
-  uint8_t *p = (uint8_t *)s;
-
-  for (size_t i = 0; i < n; i++)
+#if defined(__x86_64__)
+  int bytewise;
+  if (memops_use_rep(n, &bytewise))
   {
-    p[i] = (uint8_t)c;
+    if (bytewise)
+      memops_stosb(s, (uint8_t)c, n);
+    else
+      memops_stosq(s, (uint8_t)c, n);
+    return s;
   }
+#endif
 
+  memops_set_words((uint8_t *)s, (uint8_t)c, n);
   return s;
 }
\ No newline at end of file
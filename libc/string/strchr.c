@@ -0,0 +1,31 @@
+#include <string.h>
+#include <stdint.h>
+
+#include "swar.h"
+
+char *strchr(const char *s, int c)
+{
+  const uint8_t *p = (const uint8_t *)s;
+  uint8_t ch = (uint8_t)c;
+
+  for (; (uintptr_t)p & 7; p++)
+  {
+    if (*p == ch)
+      return (char *)p;
+    if (*p == '\0')
+      return NULL;
+  }
+
+  // Stop at the first byte that is either `ch` or the terminator.
+  uint64_t pattern = swar_repeat(ch);
+  for (;; p += 8)
+  {
+    uint64_t w = *(const swar_word *)p;
+    uint64_t stop = swar_zero(w) | swar_zero(w ^ pattern);
+    if (stop)
+    {
+      p += swar_first(stop);
+      return *p == ch ? (char *)p : NULL;
+    }
+  }
+}
\ No newline at end of file
@@ -0,0 +1,53 @@
+#include <string.h>
+#include <stdint.h>
+
+#include "swar.h"
+
+int strcmp(const char *s1, const char *s2)
+{
+  const uint8_t *a = (const uint8_t *)s1;
+  const uint8_t *b = (const uint8_t *)s2;
+
+  for (; (uintptr_t)a & 7; a++, b++)
+  {
+    if (*a != *b || *a == '\0')
+      return *a - *b;
+  }
+
+  // Compare a word at a time until the words differ or `a` ends; the byte
+  // loop below then finds where.
+  unsigned int off = (uintptr_t)b & 7;
+  if (off == 0)
+  {
+    for (;; a += 8, b += 8)
+    {
+      uint64_t w = *(const swar_word *)a;
+      if (w != *(const swar_word *)b || swar_zero(w))
+        break;
+    }
+  }
+  else
+  {
+    // `b` is misaligned: build its words from two aligned loads.
+    const swar_word *wb = (const swar_word *)(b - off);
+    uint64_t lo = *wb;
+    for (;; a += 8, b += 8, wb++)
+    {
+      // Do not load the next word if `b` ends in the rest of this one.
+      if (swar_zero(lo | swar_low_bytes(off)))
+        break;
+      uint64_t hi = wb[1];
+      uint64_t w = *(const swar_word *)a;
+      if (w != ((lo >> (off * 8)) | (hi << (64 - off * 8))) || swar_zero(w))
+        break;
+      lo = hi;
+    }
+  }
+
+  while (*a == *b && *a != '\0')
+  {
+    a++;
+    b++;
+  }
+  return *a - *b;
+}
\ No newline at end of file
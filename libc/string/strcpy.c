@@ -0,0 +1,32 @@
+#include <string.h>
+#include <stdint.h>
+
+#include "swar.h"
+
+char *strcpy(char *restrict dest, const char *restrict src)
+{
+  uint8_t *d = (uint8_t *)dest;
+  const uint8_t *s = (const uint8_t *)src;
+
+  for (; (uintptr_t)s & 7; s++, d++)
+  {
+    if ((*d = *s) == '\0')
+      return dest;
+  }
+
+  // Whole words until the one holding the terminator.
+  if (SWAR_UNALIGNED || ((uintptr_t)d & 7) == 0)
+  {
+    for (;; s += 8, d += 8)
+    {
+      uint64_t w = *(const swar_word *)s;
+      if (swar_zero(w))
+        break;
+      *(swar_uword *)d = w;
+    }
+  }
+
+  while ((*d++ = *s++) != '\0')
+    ;
+  return dest;
+}
\ No newline at end of file
@@ -0,0 +1,18 @@
+#include <string.h>
+#include <stdint.h>
+
+#include "swar.h"
+
+size_t strlen(const char *s)
+{
+  // Bytes of the first word before `s` are forced non-zero.
+  const swar_word *w = (const swar_word *)((uintptr_t)s & ~(uintptr_t)7);
+  uint64_t zero = swar_zero(*w | swar_low_bytes((uintptr_t)s & 7));
+
+  while (zero == 0)
+  {
+    zero = swar_zero(*++w);
+  }
+
+  return (const char *)w + swar_first(zero) - s;
+}
\ No newline at end of file
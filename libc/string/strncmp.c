@@ -0,0 +1,50 @@
+#include <string.h>
+#include <stdint.h>
+
+#include "swar.h"
+
+int strncmp(const char *s1, const char *s2, size_t n)
+{
+  const uint8_t *a = (const uint8_t *)s1;
+  const uint8_t *b = (const uint8_t *)s2;
+
+  for (; n && ((uintptr_t)a & 7); n--, a++, b++)
+  {
+    if (*a != *b || *a == '\0')
+      return *a - *b;
+  }
+
+  // As strcmp(), while a whole word is left to compare.
+  unsigned int off = (uintptr_t)b & 7;
+  if (off == 0)
+  {
+    for (; n >= 8; n -= 8, a += 8, b += 8)
+    {
+      uint64_t w = *(const swar_word *)a;
+      if (w != *(const swar_word *)b || swar_zero(w))
+        break;
+    }
+  }
+  else if (n >= 8)
+  {
+    const swar_word *wb = (const swar_word *)(b - off);
+    uint64_t lo = *wb;
+    for (; n >= 8; n -= 8, a += 8, b += 8, wb++)
+    {
+      if (swar_zero(lo | swar_low_bytes(off)))
+        break;
+      uint64_t hi = wb[1];
+      uint64_t w = *(const swar_word *)a;
+      if (w != ((lo >> (off * 8)) | (hi << (64 - off * 8))) || swar_zero(w))
+        break;
+      lo = hi;
+    }
+  }
+
+  for (; n; n--, a++, b++)
+  {
+    if (*a != *b || *a == '\0')
+      return *a - *b;
+  }
+  return 0;
+}
\ No newline at end of file
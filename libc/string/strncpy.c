@@ -0,0 +1,35 @@
+#include <string.h>
+#include <stdint.h>
+
+#include "swar.h"
+
+char *strncpy(char *restrict dest, const char *restrict src, size_t n)
+{
+  uint8_t *d = (uint8_t *)dest;
+  const uint8_t *s = (const uint8_t *)src;
+
+  for (; n && ((uintptr_t)s & 7) && *s != '\0'; n--)
+  {
+    *d++ = *s++;
+  }
+
+  if (((uintptr_t)s & 7) == 0 && (SWAR_UNALIGNED || ((uintptr_t)d & 7) == 0))
+  {
+    for (; n >= 8; n -= 8, s += 8, d += 8)
+    {
+      uint64_t w = *(const swar_word *)s;
+      if (swar_zero(w))
+        break;
+      *(swar_uword *)d = w;
+    }
+  }
+
+  for (; n && *s != '\0'; n--)
+  {
+    *d++ = *s++;
+  }
+
+  // Pad the rest, terminator included, with zeros.
+  memset(d, 0, n);
+  return dest;
+}
\ No newline at end of file
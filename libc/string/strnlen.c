@@ -0,0 +1,7 @@
+#include <string.h>
+
+size_t strnlen(const char *s, size_t maxlen)
+{
+  const char *end = memchr(s, '\0', maxlen);
+  return end ? (size_t)(end - s) : maxlen;
+}
\ No newline at end of file
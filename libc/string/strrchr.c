@@ -0,0 +1,37 @@
+#include <string.h>
+#include <stdint.h>
+
+#include "swar.h"
+
+char *strrchr(const char *s, int c)
+{
+  const uint8_t *p = (const uint8_t *)s;
+  const uint8_t *last = NULL;
+  uint8_t ch = (uint8_t)c;
+
+  for (; (uintptr_t)p & 7; p++)
+  {
+    if (*p == ch)
+      last = p;
+    if (*p == '\0')
+      return (char *)last;
+  }
+
+  uint64_t pattern = swar_repeat(ch);
+  for (;; p += 8)
+  {
+    uint64_t w = *(const swar_word *)p;
+    uint64_t hits = swar_zero_exact(w ^ pattern);
+    uint64_t zero = swar_zero(w);
+    if (zero)
+    {
+      // Only matches up to the terminator (included, for c == 0) count.
+      hits &= zero ^ (zero - 1);
+      if (hits)
+        last = p + swar_last(hits);
+      return (char *)last;
+    }
+    if (hits)
+      last = p + swar_last(hits);
+  }
+}
\ No newline at end of file
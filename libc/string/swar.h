@@ -0,0 +1,73 @@
+#ifndef _SWAR_H
+#define _SWAR_H 1
+
+/* Word-at-a-time helpers for the string routines ("SIMD within a
+   register"): eight bytes are tested at once with plain integer arithmetic,
+   since kernel builds have no SIMD.
+
+   Loads are aligned 8-byte words, so a word that holds a string's last byte
+   never crosses into the next page: reading the rest of it cannot fault
+   even though those bytes are past the terminator. Byte 0 of a word is the
+   lowest-addressed one; every supported architecture is little-endian. */
+
+#include <stdint.h>
+#include <stddef.h>
+
+_Static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "swar.h assumes little-endian words");
+
+#define SWAR_ONES 0x0101010101010101ull
+#define SWAR_HIGHS 0x8080808080808080ull
+#define SWAR_LOWS 0x7f7f7f7f7f7f7f7full
+
+typedef uint64_t __attribute__((__may_alias__)) swar_word;
+#if defined(__x86_64__)
+#define SWAR_UNALIGNED 1
+typedef uint64_t __attribute__((__may_alias__, __aligned__(1))) swar_uword;
+#else
+#define SWAR_UNALIGNED 0
+typedef swar_word swar_uword;
+#endif
+
+static inline uint64_t swar_repeat(unsigned char c)
+{
+  return c * SWAR_ONES;
+}
+
+/* Non-zero if some byte of `w` is zero. Only the lowest flagged byte is
+   reliable: a borrow out of a zero byte can flag a 0x01 byte above it. */
+static inline uint64_t swar_zero(uint64_t w)
+{
+  return (w - SWAR_ONES) & ~w & SWAR_HIGHS;
+}
+
+/* The high bit of exactly the zero bytes of `w`. */
+static inline uint64_t swar_zero_exact(uint64_t w)
+{
+  return ~(((w & SWAR_LOWS) + SWAR_LOWS) | w | SWAR_LOWS);
+}
+
+/* Index of the lowest flagged byte; `mask` must be non-zero. */
+static inline unsigned int swar_first(uint64_t mask)
+{
+  return __builtin_ctzll(mask) / 8;
+}
+
+/* Index of the highest flagged byte; `mask` must be non-zero. */
+static inline unsigned int swar_last(uint64_t mask)
+{
+  return (63 - __builtin_clzll(mask)) / 8;
+}
+
+/* All bits of the lowest `bytes` bytes (0..7). */
+static inline uint64_t swar_low_bytes(unsigned int bytes)
+{
+  return ((uint64_t)1 << (bytes * 8)) - 1;
+}
+
+/* Bytes to the next 8-byte boundary. */
+static inline unsigned int swar_misalign(const void *p)
+{
+  return -(uintptr_t)p & 7;
+}
+
+#endif